@@ -0,0 +1,179 @@
+/*!
+ * @file alignment_reader.cpp
+ *
+ * @brief Binary alignment output reader source file
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include "alignment_reader.hpp"
+
+constexpr size_t kStringChunkSize = 1024 * 1024;
+
+void encodeAlignmentRuns(std::string& dst, const unsigned char* alignment,
+    uint32_t length) {
+
+    for (uint32_t i = 0; i < length;) {
+        uint32_t j = i + 1;
+        while (j < length && alignment[j] == alignment[i]) {
+            ++j;
+        }
+        uint32_t run = (j - i) << 2 | (alignment[i] & 3);
+        for (; run >= 0x80; run >>= 7) {
+            dst += static_cast<char>(run | 0x80);
+        }
+        dst += static_cast<char>(run);
+        i = j;
+    }
+}
+
+void decodeAlignmentRuns(std::vector<uint32_t>& dst, const std::string& src) {
+
+    uint32_t run = 0, shift = 0;
+    for (const auto& it: src) {
+        run |= static_cast<uint32_t>(it & 0x7F) << shift;
+        if (it & 0x80) {
+            shift += 7;
+        } else {
+            dst.emplace_back(run);
+            run = 0;
+            shift = 0;
+        }
+    }
+}
+
+void expandAlignmentRuns(std::string& dst, const std::vector<uint32_t>& runs) {
+
+    for (const auto& it: runs) {
+        dst.append(it >> 2, static_cast<char>(it & 3));
+    }
+}
+
+std::unique_ptr<AlignmentReader> createAlignmentReader(const std::string& path) {
+
+    auto file = path.compare("-") == 0 ? stdin : fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    auto reader = std::unique_ptr<AlignmentReader>(new AlignmentReader(path, file));
+    if (!reader->read_header()) {
+        return nullptr;
+    }
+
+    return reader;
+}
+
+AlignmentReader::AlignmentReader(const std::string& path, FILE* file)
+        : path_(path), file_(file), matrix_(), gap_open_(), gap_extend_(),
+        target_names_(), target_lengths_(), runs_(), error_() {
+}
+
+AlignmentReader::~AlignmentReader() {
+    if (file_ != stdin) {
+        fclose(file_);
+    }
+}
+
+bool AlignmentReader::read_header() {
+
+    char magic[sizeof(kAlignmentMagic)];
+    uint32_t format = 0;
+
+    return read_bytes(magic, sizeof(magic)) &&
+        memcmp(magic, kAlignmentMagic, sizeof(magic)) == 0 &&
+        read_value(format) && format == kAlignmentFormat &&
+        read_string(matrix_) && read_value(gap_open_) && read_value(gap_extend_);
+}
+
+bool AlignmentReader::read(QueryRecord& dst) {
+
+    if (!error_.empty()) {
+        return false;
+    }
+
+    while (true) {
+
+        uint8_t type;
+        if (fread(&type, 1, 1, file_) != 1) {
+            return false;
+        }
+
+        if (type == kTargetRecord) {
+            uint32_t id = 0, length = 0;
+            if (!read_value(id) || !read_value(length)) {
+                return false;
+            }
+            target_lengths_[id] = length;
+            if (!read_string(target_names_[id])) {
+                return false;
+            }
+
+        } else if (type == kQueryRecord) {
+            uint32_t num_alignments = 0;
+            if (!read_value(dst.length) || !read_string(dst.name) ||
+                !read_value(num_alignments)) {
+                return false;
+            }
+
+            /* alignments are added one by one so that a corrupted count fails
+             * at the end of the file instead of allocating it */
+            dst.alignments.clear();
+            for (uint32_t i = 0; i < num_alignments; ++i) {
+                AlignmentRecord it;
+                if (!read_value(it.target_id) || !read_value(it.score) ||
+                    !read_value(it.evalue) || !read_value(it.query_begin) ||
+                    !read_value(it.query_end) || !read_value(it.target_begin) ||
+                    !read_value(it.target_end) || !read_string(runs_)) {
+                    return false;
+                }
+                decodeAlignmentRuns(it.runs, runs_);
+
+                if (target_names_.count(it.target_id) == 0) {
+                    return fail("alignment with an unknown target in");
+                }
+                dst.alignments.emplace_back(std::move(it));
+            }
+            return true;
+
+        } else {
+            return fail("unknown record in");
+        }
+    }
+}
+
+bool AlignmentReader::read_bytes(void* dst, size_t size) {
+    if (size != 0 && fread(dst, 1, size, file_) != size) {
+        return fail("unable to read");
+    }
+    return true;
+}
+
+bool AlignmentReader::read_string(std::string& dst) {
+
+    uint32_t length = 0;
+    if (!read_value(length)) {
+        return false;
+    }
+
+    /* read in chunks so that a corrupted length fails at the end of the file
+     * instead of allocating it */
+    dst.clear();
+    while (dst.size() < length) {
+        size_t offset = dst.size();
+        size_t size = std::min<size_t>(length - offset, kStringChunkSize);
+        dst.resize(offset + size);
+        if (!read_bytes(&dst[offset], size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AlignmentReader::fail(const char* message) {
+    if (error_.empty()) {
+        error_ = std::string(message) + " " + path_;
+    }
+    return false;
+}
@@ -0,0 +1,167 @@
+/*!
+ * @file alignment_reader.hpp
+ *
+ * @brief Binary alignment output reader header file
+ *
+ * @details Results written with outfmt bin can be read with this header and
+ * alignment_reader.cpp alone (library sword_reader), without parsing text.
+ * All values are stored in native byte order:
+ *     header:  magic (4 bytes), format (uint32), matrix (string), gap_open
+ *         (int32), gap_extend (int32)
+ *     records:  type (uint8) followed by
+ *         target:  id (uint32), length (uint32), name (string), written once
+ *             before the first alignment with the target
+ *         query:  length (uint32), name (string), number of alignments
+ *             (uint32) and the alignments as target id (uint32), score
+ *             (int32), evalue (double), query_begin, query_end, target_begin,
+ *             target_end (uint32, zero-based and inclusive), size of runs in
+ *             bytes (uint32) and runs
+ * where strings are preceded by their length (uint32). Queries are written in
+ * input order. A run is a length and an operation of the alignment stored as
+ * length << 2 | operation in a varint (7 bits per byte starting with the
+ * lowest ones, the highest bit is set if more bytes follow).
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+constexpr char kAlignmentMagic[] = {'S', 'W', 'A', 'L'};
+constexpr uint32_t kAlignmentFormat = 1;
+
+constexpr uint8_t kTargetRecord = 1;
+constexpr uint8_t kQueryRecord = 2;
+
+/* operations of an alignment */
+constexpr uint8_t kMatchOperation = 0;
+constexpr uint8_t kDeletionOperation = 1; // deletion from query (insertion to target)
+constexpr uint8_t kInsertionOperation = 2; // insertion to query (deletion from target)
+constexpr uint8_t kMismatchOperation = 3;
+
+/*!
+ * @brief Appends runs of the operations of an alignment (one per column) to
+ * dst as varints
+ */
+void encodeAlignmentRuns(std::string& dst, const unsigned char* alignment,
+    uint32_t length);
+
+/*!
+ * @brief Appends runs stored as varints in src to dst (length << 2 |
+ * operation)
+ */
+void decodeAlignmentRuns(std::vector<uint32_t>& dst, const std::string& src);
+
+/*!
+ * @brief Appends operations of an alignment (one per column) given as runs to
+ * dst
+ */
+void expandAlignmentRuns(std::string& dst, const std::vector<uint32_t>& runs);
+
+struct AlignmentRecord {
+    uint32_t target_id;
+    int32_t score;
+    double evalue;
+    uint32_t query_begin;
+    uint32_t query_end;
+    uint32_t target_begin;
+    uint32_t target_end;
+    std::vector<uint32_t> runs; // length << 2 | operation
+};
+
+struct QueryRecord {
+    uint32_t length;
+    std::string name;
+    std::vector<AlignmentRecord> alignments;
+};
+
+class AlignmentReader;
+
+/*!
+ * @brief Opens binary alignment output at path (stdin for "-"), returns
+ * nullptr if the file can not be opened or does not start with a valid header
+ * @details Errors never terminate the calling program: a file which is
+ * malformed or cut short ends reading with read() returning false and
+ * error() describing the problem.
+ */
+std::unique_ptr<AlignmentReader> createAlignmentReader(const std::string& path);
+
+class AlignmentReader {
+public:
+
+    ~AlignmentReader();
+
+    const std::string& matrix() const {
+        return matrix_;
+    }
+
+    int32_t gap_open() const {
+        return gap_open_;
+    }
+
+    int32_t gap_extend() const {
+        return gap_extend_;
+    }
+
+    /*!
+     * @brief Reads the next query into dst, returns false at the end of the
+     * file or if the file is malformed (see error)
+     */
+    bool read(QueryRecord& dst);
+
+    /*!
+     * @brief Description of the problem which ended reading, empty if the
+     * whole file was read
+     */
+    const std::string& error() const {
+        return error_;
+    }
+
+    /*!
+     * @brief Name and length of a target which has alignments with a query
+     * read so far
+     */
+    const std::string& target_name(uint32_t id) const {
+        return target_names_.at(id);
+    }
+
+    uint32_t target_length(uint32_t id) const {
+        return target_lengths_.at(id);
+    }
+
+    friend std::unique_ptr<AlignmentReader> createAlignmentReader(
+        const std::string& path);
+
+private:
+
+    AlignmentReader(const std::string& path, FILE* file);
+    AlignmentReader(const AlignmentReader&) = delete;
+    const AlignmentReader& operator=(const AlignmentReader&) = delete;
+
+    bool read_header();
+
+    template<typename T>
+    bool read_value(T& dst) {
+        return read_bytes(&dst, sizeof(T));
+    }
+
+    bool read_bytes(void* dst, size_t size);
+    bool read_string(std::string& dst);
+    bool fail(const char* message);
+
+    std::string path_;
+    FILE* file_;
+    std::string matrix_;
+    int32_t gap_open_;
+    int32_t gap_extend_;
+    /* keyed by id so that a corrupted id can not allocate memory for all
+     * smaller ones */
+    std::unordered_map<uint32_t, std::string> target_names_;
+    std::unordered_map<uint32_t, uint32_t> target_lengths_;
+    std::string runs_;
+    std::string error_;
+};
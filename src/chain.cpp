@@ -4,7 +4,14 @@
  * @brief Chain class source file
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <math.h>
+#include <functional>
+#include <unordered_map>
+
+#include "thread_pool/thread_pool.hpp"
 
 #include "reader.hpp"
 #include "chain.hpp"
@@ -41,14 +48,13 @@ std::vector<char> kCoder = {
 std::unique_ptr<Chain> createChain(uint32_t id, char* name, uint32_t name_length,
     char* data, uint32_t data_length) {
 
-    assert(name_length);
-    assert(data_length);
-
     // remove trailing white spaces
-    while (isspace(name[name_length - 1])) {
+    while (name_length > 0 && isspace(name[name_length - 1])) {
         --name_length;
     }
-    assert(name_length && "name cannot be empty");
+    if (name_length == 0) {
+        return nullptr;
+    }
 
     std::string data_;
     data_.reserve(data_length);
@@ -61,30 +67,194 @@ std::unique_ptr<Chain> createChain(uint32_t id, char* name, uint32_t name_length
             ++valid_data_length;
         }
     }
-    assert(valid_data_length && "no valid chars found");
+    if (valid_data_length == 0) {
+        return nullptr;
+    }
 
     return std::unique_ptr<Chain>(new Chain(id, std::string(name, name_length),
         std::string(data, valid_data_length)));
 }
 
-void createChainSet(ChainSet& dst, const std::string& path) {
+void createChainSet(ChainSet& dst, const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
 
-    auto reader = createChainSetPartInitialize(path);
+    auto reader = createChainSetPartInitialize(path, thread_pool);
     createChainSetPart(dst, std::move(reader), 0);
 }
 
-std::unique_ptr<Reader> createChainSetPartInitialize(const std::string& path) {
+std::unique_ptr<Reader> createChainSetPartInitialize(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
 
     /* maybe in future: check if the chains are cached */
-    return createReader(path);
+    return createReader(path, thread_pool);
 }
 
 bool createChainSetPart(ChainSet& dst, std::shared_ptr<Reader> reader, size_t max_bytes) {
 
     assert(reader);
-    return reader->read_chains(dst, max_bytes);
+    auto status = reader->read_chains(dst, max_bytes);
+    if (!reader->error().empty()) {
+        fprintf(stderr, "[sword::Chain] error: unable to read input, %s!\n",
+            reader->error().c_str());
+        exit(1);
+    }
+    return status;
+}
+
+bool createChainSetBatch(ChainSet& dst, std::shared_ptr<Reader> reader,
+    uint32_t max_chains, size_t max_bytes) {
+
+    assert(reader);
+    reader->reset_chain_ids();
+    return reader->read_chains(dst, max_bytes, max_chains);
+}
+
+uint32_t findDuplicateChains(std::vector<uint32_t>& dst, const ChainSet& chains,
+    uint32_t begin) {
+
+    dst.resize(chains.size());
+
+    std::hash<std::string> data_hash;
+    std::unordered_multimap<size_t, uint32_t> unique_chains;
+    unique_chains.reserve(chains.size() - begin);
+
+    uint32_t num_duplicates = 0;
+
+    for (uint32_t i = begin; i < chains.size(); ++i) {
+
+        dst[i] = i;
+        if (chains[i] == nullptr) {
+            continue;
+        }
+
+        auto key = data_hash(chains[i]->data());
+        auto range = unique_chains.equal_range(key);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (chains[it->second]->data() == chains[i]->data()) {
+                dst[i] = it->second;
+                ++num_duplicates;
+                break;
+            }
+        }
+
+        if (dst[i] == i) {
+            unique_chains.emplace(key, i);
+        }
+    }
+
+    return num_duplicates;
+}
+
+constexpr uint32_t kMaskWindow = 12;
+constexpr double kMaskTrigger = 2.2;
+constexpr double kMaskExtension = 2.5;
+
+/* entropy of a window with residue counts n_i is
+ * log2(W) - sum(n_i * log2(n_i)) / W, the sum is updated in constant time
+ * when the window slides by one residue */
+static void findLowComplexity(Intervals& dst, const std::string& data) {
+
+    dst.clear();
+
+    if (data.size() < kMaskWindow) {
+        return;
+    }
+
+    double n_log_n[kMaskWindow + 1];
+    n_log_n[0] = 0;
+    for (uint32_t i = 1; i <= kMaskWindow; ++i) {
+        n_log_n[i] = i * log2(i);
+    }
+
+    /* entropies below the thresholds are compared on the sums instead */
+    double trigger = (log2(kMaskWindow) - kMaskTrigger) * kMaskWindow;
+    double extension = (log2(kMaskWindow) - kMaskExtension) * kMaskWindow;
+
+    uint32_t counts[32] = {0};
+    double sum = 0;
+
+    auto add = [&](char c, int32_t delta) {
+        auto& n = counts[static_cast<uint8_t>(c) & 31];
+        sum -= n_log_n[n];
+        n += delta;
+        sum += n_log_n[n];
+    };
+
+    for (uint32_t i = 0; i < kMaskWindow - 1; ++i) {
+        add(data[i], 1);
+    }
+
+    uint32_t num_windows = data.size() - kMaskWindow + 1;
+    uint32_t run_begin = 0;
+    bool in_run = false, triggered = false;
+
+    for (uint32_t i = 0; i <= num_windows; ++i) {
+
+        bool is_low = false;
+        if (i < num_windows) {
+            add(data[i + kMaskWindow - 1], 1);
+            is_low = sum > extension;
+        }
+
+        if (is_low) {
+            if (!in_run) {
+                run_begin = i;
+                in_run = true;
+                triggered = false;
+            }
+            triggered |= sum > trigger;
+        } else if (in_run) {
+            in_run = false;
+            if (triggered) {
+                uint32_t end = i - 1 + kMaskWindow;
+                if (!dst.empty() && dst.back().second >= run_begin) {
+                    dst.back().second = end;
+                } else {
+                    dst.emplace_back(run_begin, end);
+                }
+            }
+        }
+
+        if (i < num_windows) {
+            add(data[i], -1);
+        }
+    }
+}
+
+void maskLowComplexity(ChainSet& chains, uint32_t begin,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    if (begin >= chains.size()) {
+        return;
+    }
+
+    auto mask_part = [&chains](uint32_t part_begin, uint32_t part_end) -> void {
+        for (uint32_t i = part_begin; i < part_end; ++i) {
+            if (chains[i] != nullptr) {
+                findLowComplexity(chains[i]->low_complexity_, chains[i]->data());
+            }
+        }
+    };
+
+    if (!thread_pool) {
+        mask_part(begin, chains.size());
+        return;
+    }
+
+    uint32_t num_tasks = thread_pool->num_threads();
+    uint32_t task_size = (chains.size() - begin + num_tasks - 1) / num_tasks;
+
+    std::vector<std::future<void>> thread_futures;
+    for (uint32_t i = begin; i < chains.size(); i += task_size) {
+        thread_futures.emplace_back(thread_pool->submit(mask_part, i,
+            std::min<uint32_t>(i + task_size, chains.size())));
+    }
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
 }
 
 Chain::Chain(uint32_t id, std::string&& name, std::string&& data)
-        : id_(id), name_(name), data_(data) {
+        : id_(id), name_(name), data_(data), low_complexity_() {
 }
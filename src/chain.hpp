@@ -12,20 +12,66 @@
 #include <vector>
 #include <string>
 
+namespace thread_pool {
+    class ThreadPool;
+}
+
 class Reader;
 class Chain;
 
 using ChainSet = std::vector<std::unique_ptr<Chain>>;
+using Intervals = std::vector<std::pair<uint32_t, uint32_t>>;
 
+/*!
+ * @brief Creates a chain of the residues in data (other characters are
+ * skipped), returns nullptr if name or residues are empty
+ */
 std::unique_ptr<Chain> createChain(uint32_t id, char* name, uint32_t name_length,
     char* data, uint32_t data_length);
 
-void createChainSet(ChainSet& dst, const std::string& path);
+void createChainSet(ChainSet& dst, const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
 
-std::unique_ptr<Reader> createChainSetPartInitialize(const std::string& path);
+std::unique_ptr<Reader> createChainSetPartInitialize(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
 
+/*!
+ * @brief Reads chains until max_bytes bytes of input are consumed, exits with
+ * an error if the input can not be read; returns true if there is more input
+ */
 bool createChainSetPart(ChainSet& dst, std::shared_ptr<Reader> reader, size_t max_bytes);
 
+/*!
+ * @brief Reads at most max_chains chains (and stops after max_bytes bytes of
+ * input if it is not 0), chains of each batch are numbered from 0 so that a
+ * batch can be used like a ChainSet created from a file; returns true if
+ * there is more input
+ * @details Input which can not be read ends the batches, Reader::error tells
+ * why.
+ */
+bool createChainSetBatch(ChainSet& dst, std::shared_ptr<Reader> reader,
+    uint32_t max_chains, size_t max_bytes = 0);
+
+/*!
+ * @brief Finds chains with identical data among chains[begin], ...,
+ * chains[chains.size() - 1]; dst[i] is set to the position of the first chain
+ * with the same data as chains[i] (dst[i] == i for unique chains), positions
+ * before begin are left untouched; returns the number of duplicates
+ */
+uint32_t findDuplicateChains(std::vector<uint32_t>& dst, const ChainSet& chains,
+    uint32_t begin = 0);
+
+/*!
+ * @brief Finds low complexity regions of chains[begin], ...,
+ * chains[chains.size() - 1] in the spirit of SEG (Wootton and Federhen 1993):
+ * a region is a run of 12 residue windows with compositional entropy below 2.5
+ * bits which contains a window with entropy below 2.2 bits
+ * @details Regions are used only to leave kmers out of the database search
+ * (see Chain::low_complexity), alignment always uses the whole chain.
+ */
+void maskLowComplexity(ChainSet& chains, uint32_t begin = 0,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
 class Chain {
 public:
 
@@ -51,9 +97,20 @@ public:
         return data_.size();
     }
 
+    /*!
+     * @brief Sorted, disjoint [begin, end) residue intervals of low complexity
+     * (empty unless maskLowComplexity was called)
+     */
+    const Intervals& low_complexity() const {
+        return low_complexity_;
+    }
+
     friend std::unique_ptr<Chain> createChain(uint32_t id, char* name,
         uint32_t name_length, char* data, uint32_t data_length);
 
+    friend void maskLowComplexity(ChainSet& chains, uint32_t begin,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
 private:
 
     Chain(uint32_t id, std::string&& name, std::string&& data);
@@ -63,4 +120,5 @@ private:
     uint32_t id_;
     std::string name_;
     std::string data_;
+    Intervals low_complexity_;
 };
@@ -0,0 +1,47 @@
+/*!
+ * @file database.cpp
+ *
+ * @brief Database class source file
+ */
+
+#include <assert.h>
+
+#include "thread_pool/thread_pool.hpp"
+
+#include "chain.hpp"
+#include "reader.hpp"
+#include "database_search.hpp"
+#include "database.hpp"
+
+std::unique_ptr<Database> createDatabase(std::shared_ptr<Reader> reader,
+    bool remove_duplicates, bool mask_low_complexity,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    assert(reader);
+    assert(thread_pool);
+
+    ChainSet chains;
+    reader->read_chains(chains, 0);
+    if (!reader->error().empty()) {
+        return nullptr;
+    }
+
+    if (mask_low_complexity) {
+        maskLowComplexity(chains, 0, thread_pool);
+    }
+
+    return std::unique_ptr<Database>(new Database(std::move(chains),
+        remove_duplicates, thread_pool->num_threads()));
+}
+
+Database::Database(ChainSet&& chains, bool remove_duplicates, size_t num_threads)
+        : chains_(std::move(chains)), cells_(0), search_order_(),
+        search_tasks_(), copies_() {
+
+    for (const auto& it: chains_) {
+        cells_ += it->length();
+    }
+
+    preprocDatabase(search_order_, search_tasks_, copies_, chains_,
+        num_threads, remove_duplicates);
+}
@@ -0,0 +1,89 @@
+/*!
+ * @file database.hpp
+ *
+ * @brief Database class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+
+namespace thread_pool {
+    class ThreadPool;
+}
+
+class Chain;
+class Reader;
+class Database;
+
+using ChainSet = std::vector<std::unique_ptr<Chain>>;
+
+/*!
+ * @brief Loads all chains of reader into memory, used when the same targets
+ * are searched with many query batches; chains with identical data are
+ * searched only once if remove_duplicates is set, low complexity regions are
+ * found if mask_low_complexity is set
+ * @details Returns nullptr if the input can not be read (see Reader::error).
+ */
+std::unique_ptr<Database> createDatabase(std::shared_ptr<Reader> reader,
+    bool remove_duplicates, bool mask_low_complexity,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+class Database {
+public:
+
+    ~Database() = default;
+
+    /*!
+     * @brief Chains in input order (chains()[i]->id() == i)
+     */
+    const ChainSet& chains() const {
+        return chains_;
+    }
+
+    /*!
+     * @brief Number of residues, needed for EValue
+     */
+    uint64_t cells() const {
+        return cells_;
+    }
+
+    /*!
+     * @brief Positions of chains sorted by length and split into search tasks
+     * (see preprocDatabase in database_search.hpp)
+     */
+    const std::vector<uint32_t>& search_order() const {
+        return search_order_;
+    }
+
+    const std::vector<uint32_t>& search_tasks() const {
+        return search_tasks_;
+    }
+
+    /*!
+     * @brief Links between chains with identical data, empty if duplicates
+     * are not removed (see preprocDatabase in database_search.hpp)
+     */
+    const std::vector<uint32_t>& copies() const {
+        return copies_;
+    }
+
+    friend std::unique_ptr<Database> createDatabase(std::shared_ptr<Reader> reader,
+        bool remove_duplicates, bool mask_low_complexity,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+private:
+
+    Database(ChainSet&& chains, bool remove_duplicates, size_t num_threads);
+    Database(const Database&) = delete;
+    const Database& operator=(const Database&) = delete;
+
+    ChainSet chains_;
+    uint64_t cells_;
+    std::vector<uint32_t> search_order_;
+    std::vector<uint32_t> search_tasks_;
+    std::vector<uint32_t> copies_;
+};
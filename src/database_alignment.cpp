@@ -6,18 +6,24 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <functional>
+#include <chrono>
+#include <future>
+#include <unordered_map>
 
 #include "opal.h"
+#include "thread_pool/thread_pool.hpp"
 
 #include "chain.hpp"
 #include "reader.hpp"
 #include "writer.hpp"
 #include "score_matrix.hpp"
 #include "evalue.hpp"
+#include "alignment_reader.hpp"
+#include "database_search.hpp"
+#include "memory.hpp"
 #include "database_alignment.hpp"
 
-constexpr size_t kDatabasePartSize = 1000000000; /* ~1 GB */
-
 std::unique_ptr<Alignment> createAlignment(int32_t score, double evalue,
     uint32_t query_id, uint32_t target_id) {
 
@@ -25,21 +31,87 @@ std::unique_ptr<Alignment> createAlignment(int32_t score, double evalue,
         target_id));
 }
 
+std::unique_ptr<Alignment> copyAlignment(const std::unique_ptr<Alignment>& src,
+    uint32_t query_id) {
+
+    auto dst = createAlignment(src->score_, src->evalue_, query_id,
+        src->target_id_);
+
+    dst->query_begin_ = src->query_begin_;
+    dst->query_end_ = src->query_end_;
+    dst->target_begin_ = src->target_begin_;
+    dst->target_end_ = src->target_end_;
+    dst->runs_ = src->runs_;
+    dst->length_ = src->length_;
+    dst->identities_ = src->identities_;
+    dst->positives_ = src->positives_;
+    dst->mismatches_ = src->mismatches_;
+    dst->gaps_ = src->gaps_;
+    dst->gap_openings_ = src->gap_openings_;
+
+    return dst;
+}
+
 Alignment::Alignment(int32_t score, double evalue, uint32_t query_id, uint32_t target_id)
-        : score_(score), evalue_(evalue), query_id_(query_id), target_id_(target_id) {
+        : score_(score), evalue_(evalue), query_id_(query_id), target_id_(target_id),
+        query_begin_(0), query_end_(0), target_begin_(0), target_end_(0),
+        runs_(), length_(0), identities_(0), positives_(0), mismatches_(0),
+        gaps_(0), gap_openings_(0) {
 }
 
 void Alignment::update(uint32_t query_begin, uint32_t query_end, uint32_t target_begin,
-    uint32_t target_end, const unsigned char* alignment, uint32_t length) {
+    uint32_t target_end, const unsigned char* alignment, uint32_t length,
+    const std::unique_ptr<Chain>& query, const std::unique_ptr<Chain>& target,
+    std::shared_ptr<ScoreMatrix> scorer) {
 
     query_begin_ = query_begin;
     query_end_ = query_end;
     target_begin_ = target_begin;
     target_end_ = target_end;
 
-    alignment_.clear();
+    runs_.clear();
+    encodeAlignmentRuns(runs_, alignment, length);
+    runs_.shrink_to_fit();
+
+    length_ = length;
+    identities_ = positives_ = mismatches_ = gaps_ = gap_openings_ = 0;
+
+    const auto& query_data = query->data();
+    const auto& target_data = target->data();
+    uint32_t query_ptr = query_begin, target_ptr = target_begin;
+    bool is_gap = false;
+
     for (uint32_t i = 0; i < length; ++i) {
-        alignment_ += alignment[i];
+        switch (alignment[i]) {
+            case kMatchOperation:
+                ++identities_;
+                ++positives_;
+                ++query_ptr;
+                ++target_ptr;
+                is_gap = false;
+                break;
+            case kMismatchOperation:
+                ++mismatches_;
+                if (scorer->score(query_data[query_ptr], target_data[target_ptr]) > 0) {
+                    ++positives_;
+                }
+                ++query_ptr;
+                ++target_ptr;
+                is_gap = false;
+                break;
+            default:
+                ++gaps_;
+                if (!is_gap) {
+                    ++gap_openings_;
+                    is_gap = true;
+                }
+                if (alignment[i] == kDeletionOperation) {
+                    ++query_ptr;
+                } else {
+                    ++target_ptr;
+                }
+                break;
+        }
     }
 }
 
@@ -51,9 +123,76 @@ bool compareAlignment(const std::unique_ptr<Alignment>& left,
 
     if (left->evalue() < right->evalue()) return true;
     if (left->evalue() == right->evalue() && left->score() > right->score()) return true;
+    if (left->evalue() == right->evalue() && left->score() == right->score() &&
+        left->target_id() < right->target_id()) return true;
     return false;
 }
 
+void sortAlignments(AlignmentSet& alignments, uint32_t max_alignments) {
+
+    std::sort(alignments.begin(), alignments.end(), compareAlignment);
+
+    if (max_alignments && alignments.size() > max_alignments) {
+        alignments.resize(max_alignments);
+    }
+}
+
+/* keeps alignments which are among the best max_alignments of alignments of
+ * the candidates up to their own position in search_order, these are all
+ * alignments which can be selected if only a prefix of the candidates
+ * remains (see mergeCandidates in database_search.hpp) */
+void selectPrefixAlignments(AlignmentSet& alignments,
+    const std::vector<uint32_t>& search_order, uint32_t max_alignments) {
+
+    if (max_alignments == 0 || alignments.size() <= max_alignments) {
+        sortAlignments(alignments, 0);
+        return;
+    }
+
+    std::unordered_map<uint32_t, uint32_t> ranks;
+    ranks.reserve(search_order.size());
+    for (uint32_t i = 0; i < search_order.size(); ++i) {
+        ranks.emplace(search_order[i], i);
+    }
+
+    std::vector<uint32_t> order(alignments.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t left, uint32_t right) -> bool {
+        return ranks[alignments[left]->target_id()] < ranks[alignments[right]->target_id()];
+    });
+
+    auto compare = [&](uint32_t left, uint32_t right) -> bool {
+        return compareAlignment(alignments[left], alignments[right]);
+    };
+
+    /* best holds the best max_alignments of the alignments seen so far */
+    std::vector<uint32_t> best;
+    std::vector<bool> is_selected(alignments.size(), false);
+
+    for (const auto& it: order) {
+        if (best.size() == max_alignments && !compare(it, best.back())) {
+            continue;
+        }
+        is_selected[it] = true;
+        best.insert(std::upper_bound(best.begin(), best.end(), it, compare), it);
+        if (best.size() > max_alignments) {
+            best.pop_back();
+        }
+    }
+
+    AlignmentSet selected;
+    for (uint32_t i = 0; i < alignments.size(); ++i) {
+        if (is_selected[i]) {
+            selected.emplace_back(std::move(alignments[i]));
+        }
+    }
+
+    sortAlignments(selected, 0);
+    alignments.swap(selected);
+}
+
 unsigned char* strToUnsignedCharPtr(const std::string& src) {
     auto dst = new unsigned char[src.size()];
     for (uint32_t i = 0; i < src.size(); ++i) {
@@ -77,6 +216,43 @@ uint32_t alignmentTypeToOpalMode(AlignmentType algorithm) {
     }
 }
 
+/* dst[i] is set to the position of the first of targets with the same data
+ * as database[target_ids[i]], identical targets are aligned only once */
+uint32_t findDuplicateTargets(std::vector<uint32_t>& dst, const ChainSet& database,
+    const std::vector<uint32_t>& target_ids, uint32_t length) {
+
+    dst.resize(length);
+
+    std::hash<std::string> data_hash;
+    std::unordered_multimap<size_t, uint32_t> unique_targets;
+    unique_targets.reserve(length);
+
+    uint32_t num_unique = 0;
+
+    for (uint32_t i = 0; i < length; ++i) {
+
+        dst[i] = i;
+
+        const auto& data = database[target_ids[i]]->data();
+        auto key = data_hash(data);
+        auto range = unique_targets.equal_range(key);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (database[target_ids[it->second]]->data() == data) {
+                dst[i] = it->second;
+                break;
+            }
+        }
+
+        if (dst[i] == i) {
+            unique_targets.emplace(key, i);
+            ++num_unique;
+        }
+    }
+
+    return num_unique;
+}
+
 /* ************************************************************************** */
 
 void scoreChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
@@ -92,8 +268,15 @@ void scoreChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
     auto database_length = i;
     if (database_length == 0) return;
 
-    OpalSearchResult* results[database_length];
-    for (i = 0; i < database_length; ++i) {
+    std::vector<uint32_t> duplicates;
+    auto unique_length = findDuplicateTargets(duplicates, database, indexes,
+        database_length);
+
+    /* slots[i] is the position of the opal result of the i-th target */
+    std::vector<uint32_t> slots(database_length);
+
+    OpalSearchResult* results[unique_length];
+    for (i = 0; i < unique_length; ++i) {
         results[i] = new OpalSearchResult();
         opalInitSearchResult(results[i]);
     }
@@ -101,16 +284,22 @@ void scoreChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
     unsigned char* query_ = strToUnsignedCharPtr(query->data());
     int query_length = query->length();
 
-    unsigned char* database_[database_length];
-    int database_lengths[database_length];
+    unsigned char* database_[unique_length];
+    int database_lengths[unique_length];
+
+    for (i = 0, unique_length = 0; i < database_length; ++i) {
+        if (duplicates[i] != i) {
+            slots[i] = slots[duplicates[i]];
+            continue;
+        }
+        slots[i] = unique_length++;
 
-    for (i = 0; i < database_length; ++i) {
         const auto& target = database[indexes[i]];
-        database_[i] = strToUnsignedCharPtr(target->data());
-        database_lengths[i] = target->length();
+        database_[slots[i]] = strToUnsignedCharPtr(target->data());
+        database_lengths[slots[i]] = target->length();
     }
 
-    auto error = opalSearchDatabase(query_, query_length, database_, database_length,
+    auto error = opalSearchDatabase(query_, query_length, database_, unique_length,
         database_lengths, scorer->gap_open(), scorer->gap_extend(), scorer->data(),
         scorer->num_rows_, results, OPAL_SEARCH_SCORE, algorithm,
         OPAL_OVERFLOW_SIMPLE);
@@ -119,25 +308,37 @@ void scoreChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
         fprintf(stderr, "Opal alignment failed with code %d\n", error);
     }
 
-    for (i = 0; i < database_length; ++i) {
-        if (results[i]->scoreSet == 1) {
+    /* most scores are rejected by the score thresholds, evalues are computed
+     * only for the rest */
+    ScoreThresholds thresholds(*evalue_params, max_evalue, query_length);
 
-            auto evalue = evalue_params->calculate(results[i]->score,
-                query_length, database_lengths[i]);
+    std::vector<uint32_t> passed;
+    std::vector<int32_t> scores;
+    std::vector<uint32_t> target_lengths;
 
-            if (evalue <= max_evalue) {
-                dst.emplace_back(createAlignment(results[i]->score, evalue,
-                    query->id(), indexes[i]));
-            }
+    for (i = 0; i < database_length; ++i) {
+        auto slot = slots[i];
+        if (results[slot]->scoreSet == 1 && results[slot]->score >=
+            thresholds.min_score(database_lengths[slot])) {
+
+            passed.emplace_back(i);
+            scores.emplace_back(results[slot]->score);
+            target_lengths.emplace_back(database_lengths[slot]);
         }
     }
 
-    std::sort(dst.begin(), dst.end(), compareAlignment);
+    std::vector<double> evalues;
+    evalue_params->calculate(evalues, scores, query_length, target_lengths);
 
-    if (max_alignments && dst.size() > max_alignments) {
-        dst.resize(max_alignments);
+    for (i = 0; i < passed.size(); ++i) {
+        if (evalues[i] <= max_evalue) {
+            dst.emplace_back(createAlignment(scores[i], evalues[i], query->id(),
+                indexes[passed[i]]));
+        }
     }
 
+    sortAlignments(dst, max_alignments);
+
     std::vector<uint32_t> temp(indexes.begin() + database_length, indexes.end());
     indexes.swap(temp);
 
@@ -158,10 +359,21 @@ void alignChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
 
     if (dst.size() == 0) return;
 
-    auto database_length = dst.size();
+    uint32_t database_length = dst.size();
 
-    OpalSearchResult* results[database_length];
+    std::vector<uint32_t> target_ids(database_length);
     for (uint32_t i = 0; i < database_length; ++i) {
+        target_ids[i] = dst[i]->target_id();
+    }
+
+    std::vector<uint32_t> duplicates;
+    auto unique_length = findDuplicateTargets(duplicates, database, target_ids,
+        database_length);
+
+    std::vector<uint32_t> slots(database_length);
+
+    OpalSearchResult* results[unique_length];
+    for (uint32_t i = 0; i < unique_length; ++i) {
         results[i] = new OpalSearchResult();
         opalInitSearchResult(results[i]);
     }
@@ -169,16 +381,23 @@ void alignChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
     unsigned char* query_ = strToUnsignedCharPtr(query->data());
     int query_length = query->length();
 
-    unsigned char* database_[database_length];
-    int database_lengths[database_length];
+    unsigned char* database_[unique_length];
+    int database_lengths[unique_length];
 
+    unique_length = 0;
     for (uint32_t i = 0; i < database_length; ++i) {
-        const auto& target = database[dst[i]->target_id()];
-        database_[i] = strToUnsignedCharPtr(target->data());
-        database_lengths[i] = target->length();
+        if (duplicates[i] != i) {
+            slots[i] = slots[duplicates[i]];
+            continue;
+        }
+        slots[i] = unique_length++;
+
+        const auto& target = database[target_ids[i]];
+        database_[slots[i]] = strToUnsignedCharPtr(target->data());
+        database_lengths[slots[i]] = target->length();
     }
 
-    auto error = opalSearchDatabase(query_, query_length, database_, database_length,
+    auto error = opalSearchDatabase(query_, query_length, database_, unique_length,
         database_lengths, scorer->gap_open(), scorer->gap_extend(), scorer->data(),
         scorer->num_rows_, results, OPAL_SEARCH_ALIGNMENT,
         algorithm, OPAL_OVERFLOW_SIMPLE);
@@ -188,9 +407,11 @@ void alignChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
     }
 
     for (uint32_t i = 0; i < database_length; ++i) {
-        dst[i]->update(results[i]->startLocationQuery, results[i]->endLocationQuery,
-            results[i]->startLocationTarget, results[i]->endLocationTarget,
-            results[i]->alignment, results[i]->alignmentLength);
+        auto slot = slots[i];
+        dst[i]->update(results[slot]->startLocationQuery, results[slot]->endLocationQuery,
+            results[slot]->startLocationTarget, results[slot]->endLocationTarget,
+            results[slot]->alignment, results[slot]->alignmentLength, query,
+            database[target_ids[i]], scorer);
     }
 
     for (const auto& it: database_) {
@@ -205,83 +426,413 @@ void alignChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
     }
 }
 
-void alignDatabase(std::vector<AlignmentSet>& dst, AlignmentType algorithm_,
-    const std::string& database_path, const std::string& queries_path,
-    Indexes& indexes, double max_evalue, std::shared_ptr<EValue> evalue_params,
-    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
-    const std::string& output_path, OutputType output_format,
-    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+void scoreAndAlignChains(AlignmentSet& dst, const std::unique_ptr<Chain>& query,
+    std::vector<uint32_t>& indexes, const ChainSet& database, uint32_t algorithm,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer) {
 
-    auto algorithm = alignmentTypeToOpalMode(algorithm_);
+    scoreChains(dst, query, indexes, database, 0, algorithm, max_evalue,
+        evalue_params, max_alignments, scorer);
+
+    alignChains(dst, query, database, algorithm, scorer);
+}
+
+void alignAndFormatChains(std::string& output, AlignmentSet& dst,
+    const std::unique_ptr<Chain>& query, const ChainSet& database,
+    uint32_t algorithm, std::shared_ptr<ScoreMatrix> scorer,
+    const std::unique_ptr<Writer>& writer) {
+
+    alignChains(dst, query, database, algorithm, scorer);
+
+    writer->format_alignments(output, dst, query, database);
+}
+
+void scoreAlignAndFormatChains(std::string& output, AlignmentSet& dst,
+    const std::unique_ptr<Chain>& query, std::vector<uint32_t>& indexes,
+    const ChainSet& database, uint32_t algorithm, double max_evalue,
+    std::shared_ptr<EValue> evalue_params, uint32_t max_alignments,
+    std::shared_ptr<ScoreMatrix> scorer, const std::unique_ptr<Writer>& writer) {
+
+    scoreAndAlignChains(dst, query, indexes, database, algorithm, max_evalue,
+        evalue_params, max_alignments, scorer);
+
+    writer->format_alignments(output, dst, query, database);
+}
+
+/* outputs of queries are written in query order as soon as they and all
+ * earlier queries are done (thread_futures[i] formats alignments[i] into
+ * outputs[i], duplicates and queries without a task are formatted here);
+ * release is called once alignments of a query are no longer needed */
+void writeAlignmentsInOrder(const std::unique_ptr<Writer>& writer,
+    std::vector<AlignmentSet>& alignments, std::vector<std::string>& outputs,
+    std::vector<std::future<void>>& thread_futures, const ChainSet& queries,
+    const ChainSet& database, const std::vector<uint32_t>& duplicates,
+    std::function<void(const AlignmentSet&)> release) {
+
+    /* last query which is written with the alignments of query i */
+    std::vector<uint32_t> last_uses(queries.size());
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        last_uses[duplicates[i]] = i;
+    }
+
+    std::string output;
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+
+        if (thread_futures[i].valid()) {
+            /* hand out what is ready before waiting */
+            if (thread_futures[i].wait_for(std::chrono::seconds(0)) !=
+                std::future_status::ready) {
+                writer->flush();
+            }
+            thread_futures[i].wait();
+            writer->write(outputs[i], alignments[i], database);
+            std::string().swap(outputs[i]);
+        } else {
+            output.clear();
+            writer->format_alignments(output, alignments[duplicates[i]],
+                queries[i], database);
+            writer->write(output, alignments[duplicates[i]], database);
+        }
+
+        auto j = duplicates[i];
+        if (last_uses[j] == i) {
+            if (release) {
+                release(alignments[j]);
+            }
+            AlignmentSet().swap(alignments[j]);
+        }
+    }
+
+    writer->flush();
+}
+
+/* releases chains of database from database_start on which have no
+ * alignments */
+void releaseUnusedTargets(ChainSet& database, const std::vector<AlignmentSet>& alignments,
+    uint32_t database_start) {
+
+    auto used_mask = new uint8_t[database.size()]();
+    for (const auto& it: alignments) {
+        for (const auto& alignment: it) {
+            used_mask[alignment->target_id()] = 1;
+        }
+    }
+
+    for (uint32_t i = database_start; i < database.size(); ++i) {
+        if (used_mask[i] == 0) {
+            database[i].reset(nullptr);
+        }
+    }
 
-    ChainSet queries;
-    createChainSet(queries, queries_path);
+    delete[] used_mask;
+}
+
+/* scores queries with their candidates against all parts of the database
+ * read from database_path, database keeps the chains which have alignments
+ * (which stay accounted in memory if it is set) */
+void scoreDatabase(std::vector<AlignmentSet>& dst, ChainSet& database,
+    uint32_t algorithm, const std::string& database_path,
+    const ChainSet& queries, const std::vector<uint32_t>& duplicates,
+    Indexes& indexes, double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_part_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
 
     dst.clear();
     dst.resize(queries.size());
 
-    ChainSet database;
+    database.clear();
     uint32_t database_start = 0;
-    std::shared_ptr<Reader> reader = createChainSetPartInitialize(database_path);
+    std::shared_ptr<Reader> reader = createChainSetPartInitialize(database_path,
+        thread_pool);
 
     /* find scores for indexed targets */
     while (true) {
 
-        auto status = createChainSetPart(database, reader, kDatabasePartSize);
+        auto status = createChainSetPart(database, reader,
+            databasePartSize(memory));
+
+        uint64_t part_memory = 0;
+        if (memory) {
+            part_memory = chainSetMemory(database, database_start);
+            memory->reserve(part_memory);
+        }
 
         std::vector<std::future<void>> thread_futures;
 
         for (uint32_t i = 0; i < queries.size(); ++i) {
+            if (duplicates[i] != i) {
+                continue;
+            }
             thread_futures.emplace_back(thread_pool->submit(scoreChains,
-                std::ref(dst[i]), std::ref(queries[i]), std::ref(indexes[i]),
-                std::ref(database), database_start, algorithm, max_evalue,
-                evalue_params, max_alignments, scorer));
+                std::ref(dst[i]), std::cref(queries[i]), std::ref(indexes[i]),
+                std::cref(database), database_start, algorithm, max_evalue,
+                evalue_params, max_part_alignments, scorer));
         }
 
         for (const auto& it: thread_futures) {
             it.wait();
         }
 
-        auto used_mask = new uint8_t[database.size()]();
-        for (const auto& it: dst) {
-            for (const auto& alignment: it) {
-                used_mask[alignment->target_id()] = 1;
-            }
-        }
+        releaseUnusedTargets(database, dst, database_start);
 
-        for (uint32_t i = database_start; i < database.size(); ++i) {
-            if (used_mask[i] == 0) {
-                database[i].reset(nullptr);
-            }
+        /* targets with alignments stay accounted */
+        if (memory) {
+            memory->release(part_memory - chainSetMemory(database, database_start));
         }
 
-        delete[] used_mask;
-
         if (status == false) {
             break;
         }
 
         database_start = database.size();
     }
+}
 
-    /* find alignments for best targets */
-    {
-        std::vector<std::future<void>> thread_futures;
+/* finds alignments of scored targets (see scoreDatabase) and writes each
+ * query with writer as soon as it and all earlier queries are aligned,
+ * accounted memory of the targets is released at the end */
+void alignAndWriteDatabase(const std::unique_ptr<Writer>& writer,
+    std::vector<AlignmentSet>& alignments, ChainSet& database,
+    uint32_t algorithm, const ChainSet& queries,
+    const std::vector<uint32_t>& duplicates, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto database_memory = memory ? chainSetMemory(database) : 0;
+
+    /* targets are released once all alignments with them are written */
+    std::vector<uint32_t> target_uses(database.size(), 0);
+    for (const auto& it: alignments) {
+        for (const auto& alignment: it) {
+            ++target_uses[alignment->target_id()];
+        }
+    }
+
+    /* find alignments for best targets, each query is written once it is
+     * aligned */
+    std::vector<std::string> outputs(queries.size());
+    std::vector<std::future<void>> thread_futures(queries.size());
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        if (duplicates[i] != i) {
+            continue;
+        }
+        thread_futures[i] = thread_pool->submit(alignAndFormatChains,
+            std::ref(outputs[i]), std::ref(alignments[i]), std::cref(queries[i]),
+            std::cref(database), algorithm, scorer, std::cref(writer));
+    }
+
+    writeAlignmentsInOrder(writer, alignments, outputs, thread_futures, queries,
+        database, duplicates, [&](const AlignmentSet& it) -> void {
+            for (const auto& alignment: it) {
+                if (--target_uses[alignment->target_id()] == 0) {
+                    database[alignment->target_id()].reset(nullptr);
+                }
+            }
+        });
+
+    if (memory) {
+        memory->release(database_memory);
+    }
+}
+
+void alignDatabase(std::vector<AlignmentSet>& dst, ChainSet& database,
+    AlignmentType algorithm_, const std::string& database_path,
+    const ChainSet& queries, Indexes& indexes, const Indexes& search_orders,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto algorithm = alignmentTypeToOpalMode(algorithm_);
+
+    /* duplicate queries have no candidates (see searchDatabase) */
+    std::vector<uint32_t> duplicates;
+    findDuplicateChains(duplicates, queries);
 
+    /* with search orders the best alignments can be selected only once all
+     * of them are known */
+    uint32_t max_part_alignments = search_orders.empty() ? max_alignments : 0;
+
+    scoreDatabase(dst, database, algorithm, database_path, queries, duplicates,
+        indexes, max_evalue, evalue_params, max_part_alignments, scorer,
+        memory, thread_pool);
+
+    if (!search_orders.empty()) {
         for (uint32_t i = 0; i < queries.size(); ++i) {
-            thread_futures.emplace_back(thread_pool->submit(alignChains,
-                std::ref(dst[i]), std::ref(queries[i]), std::ref(database),
-                algorithm, scorer));
+            selectPrefixAlignments(dst[i], search_orders[i], max_alignments);
         }
+    }
 
+    /* find alignments for best targets */
+    std::vector<std::future<void>> thread_futures;
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        if (duplicates[i] != i) {
+            continue;
+        }
+        thread_futures.emplace_back(thread_pool->submit(alignChains,
+            std::ref(dst[i]), std::cref(queries[i]), std::cref(database),
+            algorithm, scorer));
+    }
+
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
+}
+
+void alignDatabase(const std::unique_ptr<Writer>& writer, AlignmentType algorithm_,
+    const std::string& database_path, const ChainSet& queries, Indexes& indexes,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto algorithm = alignmentTypeToOpalMode(algorithm_);
+
+    /* duplicate queries have no candidates (see searchDatabase) and get the
+     * alignments of their first copy */
+    std::vector<uint32_t> duplicates;
+    findDuplicateChains(duplicates, queries);
+
+    std::vector<AlignmentSet> alignments;
+    ChainSet database;
+    scoreDatabase(alignments, database, algorithm, database_path, queries,
+        duplicates, indexes, max_evalue, evalue_params, max_alignments, scorer,
+        memory, thread_pool);
+
+    alignAndWriteDatabase(writer, alignments, database, algorithm, queries,
+        duplicates, scorer, memory, thread_pool);
+}
+
+void searchAndAlignDatabase(const std::unique_ptr<Writer>& writer,
+    AlignmentType algorithm_, const std::string& database_path,
+    ChainSet& queries, std::shared_ptr<Kmers> kmers, uint32_t max_candidates,
+    bool remove_duplicates, bool mask_low_complexity, double max_evalue,
+    std::shared_ptr<EValue> evalue_params, uint32_t max_alignments,
+    std::shared_ptr<ScoreMatrix> scorer, std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto algorithm = alignmentTypeToOpalMode(algorithm_);
+
+    /* duplicate queries have no candidates (see searchDatabase) */
+    std::vector<uint32_t> duplicates;
+    findDuplicateChains(duplicates, queries);
+
+    std::vector<AlignmentSet> alignments(queries.size());
+    ChainSet database;
+    uint32_t database_start = 0;
+
+    /* candidates of the last part are scored while the next part is read and
+     * searched, each query keeps its best max_alignments alignments */
+    Indexes indexes;
+    std::vector<std::future<void>> thread_futures;
+    uint64_t part_memory = 0;
+
+    auto wait_for_part = [&]() -> void {
         for (const auto& it: thread_futures) {
             it.wait();
         }
+        thread_futures.clear();
+        releaseUnusedTargets(database, alignments, database_start);
+        if (memory) {
+            memory->release(part_memory - chainSetMemory(database, database_start));
+        }
+    };
+
+    searchDatabase(queries, database_path, kmers, max_candidates,
+        remove_duplicates, mask_low_complexity,
+        [&](ChainSet& database_part, const Indexes& candidates) -> void {
+
+            wait_for_part();
+
+            database_start = database.size();
+            database.resize(database_part.back()->id() + 1);
+            for (auto& it: database_part) {
+                auto id = it->id();
+                database[id] = std::move(it);
+            }
+            if (memory) {
+                part_memory = chainSetMemory(database, database_start);
+                memory->reserve(part_memory);
+            }
+
+            indexes = candidates;
+            for (uint32_t i = 0; i < queries.size(); ++i) {
+                if (indexes[i].empty()) {
+                    continue;
+                }
+                thread_futures.emplace_back(thread_pool->submit(scoreChains,
+                    std::ref(alignments[i]), std::cref(queries[i]),
+                    std::ref(indexes[i]), std::cref(database), database_start,
+                    algorithm, max_evalue, evalue_params, max_alignments,
+                    scorer));
+            }
+        }, memory, thread_pool);
+
+    wait_for_part();
+
+    alignAndWriteDatabase(writer, alignments, database, algorithm, queries,
+        duplicates, scorer, memory, thread_pool);
+}
+
+void alignDatabase(std::vector<AlignmentSet>& dst, AlignmentType algorithm_,
+    const ChainSet& queries, const ChainSet& database, Indexes& indexes,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto algorithm = alignmentTypeToOpalMode(algorithm_);
+
+    dst.clear();
+    dst.resize(queries.size());
+
+    /* the whole database is present, scores and alignments are computed in
+     * the same task */
+    std::vector<std::future<void>> thread_futures;
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        if (indexes[i].empty()) {
+            continue;
+        }
+        thread_futures.emplace_back(thread_pool->submit(scoreAndAlignChains,
+            std::ref(dst[i]), std::cref(queries[i]), std::ref(indexes[i]),
+            std::cref(database), algorithm, max_evalue, evalue_params,
+            max_alignments, scorer));
+    }
+
+    for (const auto& it: thread_futures) {
+        it.wait();
     }
+}
+
+void alignDatabase(const std::unique_ptr<Writer>& writer, AlignmentType algorithm_,
+    const ChainSet& queries, const ChainSet& database, Indexes& indexes,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto algorithm = alignmentTypeToOpalMode(algorithm_);
 
-    auto writer = createWriter(output_path, output_format, scorer);
+    std::vector<uint32_t> duplicates;
+    findDuplicateChains(duplicates, queries);
 
-    for (const auto& it: dst) {
-        writer->write_alignments(it, queries, database);
+    std::vector<AlignmentSet> alignments(queries.size());
+    std::vector<std::string> outputs(queries.size());
+    std::vector<std::future<void>> thread_futures(queries.size());
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        if (indexes[i].empty()) {
+            continue;
+        }
+        thread_futures[i] = thread_pool->submit(scoreAlignAndFormatChains,
+            std::ref(outputs[i]), std::ref(alignments[i]), std::cref(queries[i]),
+            std::ref(indexes[i]), std::cref(database), algorithm, max_evalue,
+            evalue_params, max_alignments, scorer, std::cref(writer));
     }
+
+    writeAlignmentsInOrder(writer, alignments, outputs, thread_futures, queries,
+        database, duplicates, nullptr);
 }
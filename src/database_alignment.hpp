@@ -10,13 +10,19 @@
 #include <string.h>
 #include <vector>
 #include <memory>
+#include <string>
 
-#include "thread_pool/thread_pool.hpp"
+namespace thread_pool {
+    class ThreadPool;
+}
 
-enum class OutputType;
+class Chain;
+class Writer;
 class ScoreMatrix;
 class EValue;
 class Alignment;
+class Kmers;
+class MemoryAccountant;
 
 enum class AlignmentType {
     kNW, // global alignment (Needleman-Wunsch)
@@ -25,12 +31,19 @@ enum class AlignmentType {
     kSW // local alignment (Smith-Waterman)
 };
 
+using ChainSet = std::vector<std::unique_ptr<Chain>>;
 using Indexes = std::vector<std::vector<uint32_t>>;
 using AlignmentSet = std::vector<std::unique_ptr<Alignment>>;
 
 std::unique_ptr<Alignment> createAlignment(int32_t score, double evalue,
     uint32_t query_id, uint32_t target_id);
 
+/*!
+ * @brief Copy of src for query with query_id (a duplicate of query of src)
+ */
+std::unique_ptr<Alignment> copyAlignment(const std::unique_ptr<Alignment>& src,
+    uint32_t query_id);
+
 class Alignment {
 public:
 
@@ -68,15 +81,59 @@ public:
         return target_end_;
     }
 
-    const std::string& alignment() const {
-        return alignment_;
+    /*!
+     * @brief Operations of the alignment as runs (see encodeAlignmentRuns)
+     */
+    const std::string& runs() const {
+        return runs_;
+    }
+
+    /*!
+     * @brief Number of columns of the alignment
+     */
+    uint32_t length() const {
+        return length_;
+    }
+
+    uint32_t identities() const {
+        return identities_;
+    }
+
+    /*!
+     * @brief Columns with a positive score (including identities)
+     */
+    uint32_t positives() const {
+        return positives_;
+    }
+
+    uint32_t mismatches() const {
+        return mismatches_;
+    }
+
+    uint32_t gaps() const {
+        return gaps_;
+    }
+
+    /*!
+     * @brief Number of maximal stretches of gap columns (in query or target)
+     */
+    uint32_t gap_openings() const {
+        return gap_openings_;
     }
 
+    /*!
+     * @brief Sets the aligned regions and the operations of the alignment
+     * (one per column), which are stored as runs and counted once
+     */
     void update(uint32_t query_begin, uint32_t query_end, uint32_t target_begin,
-        uint32_t target_end, const unsigned char* alignment, uint32_t length);
+        uint32_t target_end, const unsigned char* alignment, uint32_t length,
+        const std::unique_ptr<Chain>& query, const std::unique_ptr<Chain>& target,
+        std::shared_ptr<ScoreMatrix> scorer);
 
     friend std::unique_ptr<Alignment> createAlignment(int32_t score,
         double evalue, uint32_t query_id, uint32_t target_id);
+    friend std::unique_ptr<Alignment> copyAlignment(
+        const std::unique_ptr<Alignment>& src, uint32_t query_id);
 
 private:
 
@@ -96,12 +153,94 @@ private:
     uint32_t target_begin_;
     uint32_t target_end_;
 
-    std::string alignment_;
+    std::string runs_;
+    uint32_t length_;
+    uint32_t identities_;
+    uint32_t positives_;
+    uint32_t mismatches_;
+    uint32_t gaps_;
+    uint32_t gap_openings_;
 };
 
+/*!
+ * @brief Sorts alignments by evalue (ties by score and target id) and keeps
+ * the best max_alignments of them (all if 0)
+ */
+void sortAlignments(AlignmentSet& alignments, uint32_t max_alignments);
+
+/*!
+ * @brief Aligns queries with their candidates (sorted target ids), database
+ * is read from database_path and keeps the chains which have alignments
+ * (database[i]->id() == i, other chains are nullptr)
+ * @details If search_orders is not empty, search_orders[i] contains the
+ * candidates of query i in search order (best first) and an alignment is kept
+ * if it is among the best max_alignments of the alignments of candidates up to
+ * its own; these are all alignments which can be reported for any prefix of
+ * the candidates (e.g. when candidates of a shard of the database are merged
+ * with other shards, see mergeCandidates).
+ */
+void alignDatabase(std::vector<AlignmentSet>& dst, ChainSet& database,
+    AlignmentType algorithm, const std::string& database_path,
+    const ChainSet& queries, Indexes& indexes, const Indexes& search_orders,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+/*!
+ * @brief Aligns queries (with ids 0, ..., queries.size() - 1) with their
+ * candidates, the database is read from database_path part by part (sized by
+ * memory if it is set); each query is written with writer (in query order) as
+ * soon as it and all earlier queries are aligned
+ * @details Alignments of a written query and targets which no longer have
+ * alignments with unwritten queries are released.
+ */
+void alignDatabase(const std::unique_ptr<Writer>& writer, AlignmentType algorithm,
+    const std::string& database_path, const ChainSet& queries, Indexes& indexes,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+/*!
+ * @brief Searches queries against the database read from database_path (see
+ * searchDatabase) and scores the candidates of each part while the next part
+ * is searched, so that the database is read only once; alignments are written
+ * with writer as with alignDatabase
+ * @details Targets which are candidates of a query after their part is
+ * searched are scored even if they are replaced by better candidates of later
+ * parts (candidates_zscore cannot be applied). The results equal those of
+ * searchDatabase and alignDatabase whenever the database is read as a single
+ * part or no candidate is replaced, otherwise alignments with replaced
+ * candidates can be reported as well.
+ */
+void searchAndAlignDatabase(const std::unique_ptr<Writer>& writer,
+    AlignmentType algorithm, const std::string& database_path,
+    ChainSet& queries, std::shared_ptr<Kmers> kmers, uint32_t max_candidates,
+    bool remove_duplicates, bool mask_low_complexity, double max_evalue,
+    std::shared_ptr<EValue> evalue_params, uint32_t max_alignments,
+    std::shared_ptr<ScoreMatrix> scorer, std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+/*!
+ * @brief Aligns in-memory queries (with ids 0, ..., queries.size() - 1) with
+ * their candidates, database has to contain all chains (database[i]->id() ==
+ * i); dst[i] contains alignments of query with id i (empty for duplicate
+ * queries, see searchDatabase)
+ */
 void alignDatabase(std::vector<AlignmentSet>& dst, AlignmentType algorithm,
-    const std::string& database_path, const std::string& queries_path,
-    Indexes& indexes, double max_evalue, std::shared_ptr<EValue> evalue_params,
+    const ChainSet& queries, const ChainSet& database, Indexes& indexes,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
+    uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+/*!
+ * @brief Same as above, but alignments are not kept and each query is
+ * written with writer (in query order) as soon as it and all earlier queries
+ * are aligned
+ */
+void alignDatabase(const std::unique_ptr<Writer>& writer, AlignmentType algorithm,
+    const ChainSet& queries, const ChainSet& database, Indexes& indexes,
+    double max_evalue, std::shared_ptr<EValue> evalue_params,
     uint32_t max_alignments, std::shared_ptr<ScoreMatrix> scorer,
-    const std::string& output_path, OutputType output_format,
     std::shared_ptr<thread_pool::ThreadPool> thread_pool);
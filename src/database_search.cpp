@@ -4,6 +4,8 @@
  * @brief Database search source file
  */
 
+#include <assert.h>
+#include <math.h>
 #include <algorithm>
 
 #include "chain.hpp"
@@ -11,14 +13,12 @@
 #include "kmers.hpp"
 #include "hash.hpp"
 #include "utils.hpp"
+#include "database.hpp"
+#include "memory.hpp"
 #include "database_search.hpp"
 
-constexpr size_t kDatabasePartSize = 1000000000; /* ~1 GB */
 constexpr uint32_t kMaxShortChainLength = 2000;
 
-constexpr uint32_t kProtBits = 5;
-std::vector<uint32_t> kKmerDelMask = { 0, 0, 0, 0x7FFF, 0xFFFFF, 0x1FFFFFF };
-
 /* ************************************************************************** */
 /* ChainEntry - used to store additional data of Chain objects */
 
@@ -29,8 +29,8 @@ class ChainEntry {
 public:
 
     ChainEntry() {};
-    ChainEntry(uint32_t chain_idx, uint32_t data)
-            : chain_idx_(chain_idx), data_(data) {
+    ChainEntry(uint32_t chain_idx, uint32_t data, uint32_t length)
+            : chain_idx_(chain_idx), data_(data), length_(length) {
     };
 
     ~ChainEntry() = default;
@@ -43,40 +43,144 @@ public:
         return data_;
     }
 
+    uint32_t length() const {
+        return length_;
+    }
+
 private:
 
     uint32_t chain_idx_;
     uint32_t data_;
+    uint32_t length_;
 };
 
+/* ties are broken in favour of shorter chains (for which the same score is
+ * less likely by chance) and then by chain id, so that candidates do not
+ * depend on the order in which search tasks finish or on how the database is
+ * sharded */
 bool compareChainEntryDsc(const ChainEntry& left, const ChainEntry& right) {
-    return left.data() > right.data();
+    if (left.data() != right.data()) {
+        return left.data() > right.data();
+    }
+    if (left.length() != right.length()) {
+        return left.length() < right.length();
+    }
+    return left.chain_idx() < right.chain_idx();
 }
 
+/* ************************************************************************** */
+/* ScoreHistogram - distribution of diagonal scores of all targets for a query */
+
+/* scores of the last bin are not part of the background, a target which
+ * reaches it shares a long (or well conserved) diagonal with the query */
+constexpr uint32_t kHistogramBins = 64;
+
+class ScoreHistogram;
+using ScoreHistogramSet = std::vector<ScoreHistogram>;
+
+class ScoreHistogram {
+public:
+
+    ScoreHistogram()
+            : counts_() {
+    }
+
+    ~ScoreHistogram() = default;
+
+    void add(uint32_t score, uint32_t count = 1) {
+        counts_[std::min(score, kHistogramBins - 1)] += count;
+    }
+
+    void add(const ScoreHistogram& other) {
+        for (uint32_t i = 0; i < kHistogramBins; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+    }
+
+    /* lowest score which lies at least zscore standard deviations above the
+     * mean of the background scores */
+    uint32_t cutoff(double zscore) const {
+
+        double n = 0, sum = 0, squares = 0;
+        for (uint32_t i = 0; i < kHistogramBins - 1; ++i) {
+            n += counts_[i];
+            sum += counts_[i] * (double) i;
+            squares += counts_[i] * (double) i * i;
+        }
+
+        if (n == 0) {
+            return 0;
+        }
+
+        double mean = sum / n;
+        double deviation = sqrt(std::max(squares / n - mean * mean, 0.0));
+
+        return ceil(mean + zscore * deviation);
+    }
+
+    uint32_t count(uint32_t bin) const {
+        return counts_[bin];
+    }
+
+private:
+
+    uint32_t counts_[kHistogramBins];
+};
+
 /* ************************************************************************** */
 /* Chain preproces */
 
-bool compareChainByLengthAsc(const std::unique_ptr<Chain>& left,
-    const std::unique_ptr<Chain>& right) {
+/* chains which are duplicates of earlier chains are left out if duplicates
+ * (see findDuplicateChains) is not empty */
+void sortChainsByLength(std::vector<uint32_t>& dst, const ChainSet& chains,
+    const std::vector<uint32_t>& duplicates) {
+
+    dst.clear();
+    dst.reserve(chains.size());
+    for (uint32_t i = 0; i < chains.size(); ++i) {
+        if (duplicates.empty() || duplicates[i] == i) {
+            dst.emplace_back(i);
+        }
+    }
 
-    return left->length() < right->length();
+    std::sort(dst.begin(), dst.end(),
+        [&chains](uint32_t left, uint32_t right) -> bool {
+            return chains[left]->length() < chains[right]->length();
+        });
 }
 
-void preprocDatabase(std::vector<uint32_t>& dst, ChainSet& database,
-    size_t num_threads) {
+void preprocDatabase(std::vector<uint32_t>& order, std::vector<uint32_t>& dst,
+    std::vector<uint32_t>& copies, const ChainSet& database, size_t num_threads,
+    bool remove_duplicates) {
+
+    std::vector<uint32_t> duplicates;
+    copies.clear();
+
+    if (remove_duplicates) {
+        findDuplicateChains(duplicates, database);
+
+        /* each chain is linked to the next one with the same data */
+        copies.assign(database.size(), kNoCopy);
+        for (uint32_t i = database.size(); i-- > 0;) {
+            if (duplicates[i] != i) {
+                copies[i] = copies[duplicates[i]];
+                copies[duplicates[i]] = i;
+            }
+        }
+    }
 
-    sort(database.begin(), database.end(), compareChainByLengthAsc);
+    sortChainsByLength(order, database, duplicates);
 
     uint64_t short_total_length = 0;
     uint64_t long_total_length = 0;
     uint32_t split = 0;
 
-    for (uint32_t i = 0; i < database.size(); ++i) {
-        if (database[i]->length() > kMaxShortChainLength) {
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        if (database[order[i]]->length() > kMaxShortChainLength) {
             if (split == 0) split = i;
-            long_total_length += database[i]->length();
+            long_total_length += database[order[i]]->length();
         } else {
-            short_total_length += database[i]->length();
+            short_total_length += database[order[i]]->length();
         }
     }
 
@@ -85,19 +189,20 @@ void preprocDatabase(std::vector<uint32_t>& dst, ChainSet& database,
     }
 
     if (long_total_length == 0) {
-        split = database.size();
+        split = order.size();
     }
 
     uint64_t short_task_size = short_total_length / num_threads;
     uint64_t long_task_size = long_total_length / num_threads;
 
+    dst.clear();
     dst.reserve(2 * num_threads + 1);
     dst.emplace_back(0);
 
     uint64_t total_length = 0;
 
     for (uint32_t i = 0; i < split; ++i) {
-        total_length += database[i]->length();
+        total_length += database[order[i]]->length();
 
         if (total_length > short_task_size) {
             total_length = 0;
@@ -110,8 +215,8 @@ void preprocDatabase(std::vector<uint32_t>& dst, ChainSet& database,
     }
 
     total_length = 0;
-    for (uint32_t i = split; i < database.size(); ++i) {
-        total_length += database[i]->length();
+    for (uint32_t i = split; i < order.size(); ++i) {
+        total_length += database[order[i]]->length();
 
         if (total_length > long_task_size) {
             total_length = 0;
@@ -119,119 +224,302 @@ void preprocDatabase(std::vector<uint32_t>& dst, ChainSet& database,
         }
     }
 
-    if (dst.back() != database.size()) {
-        dst.emplace_back(database.size());
+    if (dst.back() != order.size()) {
+        dst.emplace_back(order.size());
+    }
+}
+
+/* identical queries are searched only once, the rest get no candidates */
+void sortQueries(std::vector<uint32_t>& dst, const ChainSet& queries) {
+
+    std::vector<uint32_t> duplicates;
+    auto num_duplicates = findDuplicateChains(duplicates, queries);
+
+    if (num_duplicates > 0) {
+        fprintf(stderr, "[sword::] skipping %u duplicate queries\n",
+            num_duplicates);
+    }
+
+    sortChainsByLength(dst, queries, duplicates);
+}
+
+/* ************************************************************************** */
+/* Seed scanning */
+
+/* number of kmers between prefetching the bucket offsets of a kmer and
+ * looking it up, its hits are prefetched halfway */
+constexpr uint32_t kPrefetchDistance = 16;
+
+/* adds hits of target kmers formed with seed to scores of diagonals; a
+ * diagonal is identified by diagonal_offset + (query - target) position,
+ * where diagonal_offset is the target length minus the shortest seed span;
+ * kmer codes of the target are computed first into kmer_buffer so that hash
+ * buckets can be prefetched ahead of the lookups (kmers in low complexity
+ * regions are redirected to the empty masked key) */
+template<uint32_t kSeed, uint32_t kBits>
+struct ScanTarget {
+
+    static void run(uint16_t* scores, uint16_t* max_score,
+        const uint32_t* score_starts, Hash& hash, uint32_t seed_, uint32_t bits_,
+        uint32_t hash_offset, uint32_t diagonal_offset,
+        const Chain& target, const char* residue_map,
+        std::vector<uint32_t>& kmer_buffer) {
+
+        const auto& sequence = target.data();
+
+        const uint32_t seed = kSeed ? kSeed : seed_;
+        const uint32_t bits = kBits ? kBits : bits_;
+        const uint32_t span = seedSpan(seed);
+
+        if (sequence.size() < span) {
+            return;
+        }
+
+        uint32_t num_kmers = sequence.size() - span + 1;
+
+        /* the tail is padded with a valid key so that prefetching needs no
+         * bound checks */
+        kmer_buffer.resize(num_kmers + kPrefetchDistance);
+        auto kmers = kmer_buffer.data();
+        std::fill_n(kmers + num_kmers, kPrefetchDistance, hash_offset);
+
+        uint64_t window = 0;
+        for (uint32_t k = 0; k < span - 1; ++k) {
+            window = (window << bits) | residue_map[static_cast<uint8_t>(sequence[k])];
+        }
+
+        for (uint32_t k = span - 1, p = 0; k < sequence.size(); ++k, ++p) {
+            window = (window << bits) | residue_map[static_cast<uint8_t>(sequence[k])];
+            kmers[p] = (kSeed ? SeedCode<kSeed, kBits>::get(window) :
+                seedCode(window, seed, bits)) + hash_offset;
+        }
+
+        maskKmers(kmers, num_kmers, target.low_complexity(), span,
+            hash.masked_key());
+
+        for (uint32_t p = 0; p < kPrefetchDistance; ++p) {
+            hash.prefetch_offsets(kmers[p]);
+        }
+
+        Hash::Iterator begin, end;
+
+        for (uint32_t p = 0; p < num_kmers; ++p) {
+
+            hash.prefetch_offsets(kmers[p + kPrefetchDistance]);
+            hash.prefetch_hits(kmers[p + kPrefetchDistance / 2]);
+
+            if (!hash.has_hits(kmers[p])) {
+                continue;
+            }
+
+            hash.hits(begin, end, kmers[p]);
+            for (; begin != end; ++begin) {
+                auto diagonal = diagonal_offset - p + begin->position() +
+                    score_starts[begin->id()];
+                ++scores[diagonal];
+                if (max_score[begin->id()] < scores[diagonal]) {
+                    max_score[begin->id()] = scores[diagonal];
+                }
+            }
+        }
     }
+};
+
+/* ************************************************************************** */
+
+/* cache available to a search task for the diagonal scores and hash hits of a
+ * query group, the per core L2 cache (or a default if it cannot be read) */
+constexpr size_t kDefaultCacheBudget = 1024 * 1024;
+
+size_t searchCacheBudget() {
+
+    static const size_t budget = []() {
+        auto size = cacheSize(2);
+        return size > 0 ? size : kDefaultCacheBudget;
+    }();
+
+    return budget;
 }
 
 /* ************************************************************************** */
 
 using MutexPtr = std::unique_ptr<std::mutex>;
 
+/* diagonals of a query and a target which share kmers of the given span, none
+ * if either chain is shorter than the span */
+static uint32_t numDiagonals(uint32_t query_length, uint32_t target_length,
+    uint32_t span) {
+
+    if (query_length < span || target_length < span) {
+        return 0;
+    }
+    return query_length + target_length - 2 * span + 1;
+}
+
+/* queries and database are accessed through orders sorted by chain length,
+ * the database slice is [database_order[database_start], ...,
+ * database_order[database_end - 1]]; targets left out of database_order as
+ * duplicates are reported with the score of their copy in the slice through
+ * database_copies (if not empty); specialized for kmers with a single seed
+ * kSeed of kBits wide residues, scoreChains<0, 0> handles any kmers */
+template<uint32_t kSeed, uint32_t kBits>
 void scoreChains(ChainEntrySet& dst, std::vector<MutexPtr>& entry_mutexes,
-    size_t max_candidates, const ChainSet& queries, const ChainSet& database,
-    uint32_t database_start, uint32_t database_end, std::shared_ptr<Kmers> kmers) {
+    ScoreHistogramSet& histograms, size_t max_candidates, const ChainSet& queries,
+    const std::vector<uint32_t>& queries_order, const ChainSet& database,
+    const std::vector<uint32_t>& database_order,
+    const std::vector<uint32_t>& database_copies, uint32_t database_start,
+    uint32_t database_end, std::shared_ptr<Kmers> kmers) {
 
     timeval start;
     gettimeofday(&start, nullptr);
 
     ChainEntrySet entries_part(queries.size());
 
-    std::unique_ptr<uint16_t[]> min_entry_score(new uint16_t[queries.size()]);
-    std::unique_ptr<uint16_t[]> entries_found(new uint16_t[queries.size()]);
+    std::unique_ptr<uint16_t[]> min_entry_score(new uint16_t[queries_order.size()]);
+    std::unique_ptr<uint16_t[]> entries_found(new uint16_t[queries_order.size()]);
 
     {
-        for (uint32_t i = 0; i < queries.size(); ++i) {
-            auto id = queries[i]->id();
+        for (uint32_t i = 0; i < queries_order.size(); ++i) {
+            auto id = queries[queries_order[i]]->id();
             std::unique_lock<std::mutex> lock(*(entry_mutexes[id].get()));
             entries_found[i] = dst[id].size();
             min_entry_score[i] = entries_found[i] > 0 ? dst[id].back().data() : 65000;
         }
     }
 
-    uint32_t kmer_length = kmers->kmer_length();
-    uint32_t max_target_length = database[database_end - 1]->length();
+    const uint32_t kmer_length = kSeed ? seedWeight(kSeed) : kmers->kmer_length();
+    const uint32_t span = kSeed ? seedSpan(kSeed) : kmers->span();
+
+    uint32_t max_target_length = database[database_order[database_end - 1]]->length();
     size_t groups = 0;
 
-    uint32_t kmer_offset = kmer_length - 1;
-    uint32_t del_mask = kKmerDelMask[kmer_length];
+    const char* residue_map = kmers->residue_map().data();
 
-    uint32_t max_scores_length = kmer_length == 3 ? 100000 : 500000;
-    std::unique_ptr<uint16_t[]> scores(new uint16_t[max_scores_length]());
-    std::unique_ptr<uint32_t[]> score_lengths(new uint32_t[queries.size()]);
-    std::unique_ptr<uint32_t[]> score_starts(new uint32_t[queries.size()+1]);
+    using ScanTargetFunction = decltype(&ScanTarget<0, 0>::run);
+    std::vector<ScanTargetFunction> scan_target_functions;
+    if (!kSeed) {
+        for (const auto& it: kmers->seeds()) {
+            scan_target_functions.emplace_back(specializeSeed<ScanTarget>(it,
+                kmers->residue_bits()));
+        }
+    }
+
+    /* a group of queries is sized so that its diagonal scores and hash hits
+     * fit into the cache budget; building the hash of a group walks all bucket
+     * offsets, so groups are never made smaller than the offsets (which is
+     * the case for long kmers, whose offsets do not fit into any cache) */
+    const size_t cache_budget = std::max(searchCacheBudget(),
+        sizeof(uint32_t) * kmers->num_kmers() * kmers->seeds().size());
+    const double hits_per_position = kmers->seeds().size() *
+        kmers->neighbourhood_size();
+
+    std::vector<uint16_t> scores;
+    std::unique_ptr<uint32_t[]> score_lengths(new uint32_t[queries_order.size()]);
+    std::unique_ptr<uint32_t[]> score_starts(new uint32_t[queries_order.size()+1]);
     score_starts[0] = 0;
-    std::unique_ptr<uint16_t[]> max_score(new uint16_t[queries.size()]());
+    std::unique_ptr<uint16_t[]> max_score(new uint16_t[queries_order.size()]());
+    std::vector<uint32_t> kmer_buffer;
 
     uint32_t min_score = kmer_length == 3 ? 1 : 0;
 
-    for (uint32_t i = 0; i < queries.size();) {
+    for (uint32_t i = 0; i < queries_order.size();) {
 
         ++groups;
 
         uint32_t group_length = 0;
-        uint32_t scores_length = 0;
+        size_t scores_length = 0;
+        size_t group_bytes = 0;
 
-        for (uint32_t j = i; j < queries.size(); ++j) {
+        for (uint32_t j = i; j < queries_order.size(); ++j) {
 
-            uint32_t length = queries[j]->length() + max_target_length -
-                2 * kmer_length + 1;
+            uint32_t query_length = queries[queries_order[j]]->length();
+            uint32_t length = numDiagonals(query_length, max_target_length, span);
+            size_t positions = query_length < span ? 0 : query_length - span + 1;
+            size_t bytes = length * sizeof(uint16_t) + sizeof(Hit) *
+                static_cast<size_t>(hits_per_position * positions);
 
-            if (scores_length + length > max_scores_length && group_length > 0) {
+            if ((group_bytes + bytes > cache_budget && group_length > 0) ||
+                group_length == kMaxHashChains) {
                 break;
             }
 
             scores_length += length;
+            group_bytes += bytes;
             ++group_length;
         }
 
-        auto hash = createHash(queries, i, group_length, kmers);
-        Hash::Iterator begin, end;
+        if (scores.size() < scores_length) {
+            scores.resize(scores_length, 0);
+        }
+
+        auto hash = createHash(queries, queries_order, i, group_length, kmers);
+
+        /* scores of all targets (also of those which do not become candidates)
+         * form the background of each query */
+        ScoreHistogramSet histograms_part(group_length);
 
         for (uint32_t j = database_start; j < database_end; ++j) {
 
+            const auto& target = database[database_order[j]];
+
             for (uint32_t k = 0; k < group_length; ++k) {
-                score_lengths[k] = queries[i + k]->length() + database[j]->length()
-                    - 2 * kmer_length + 1;
+                score_lengths[k] = numDiagonals(queries[queries_order[i + k]]->length(),
+                    target->length(), span);
                 score_starts[k + 1] = score_starts[k] + score_lengths[k];
             }
 
-            const auto& sequence = database[j]->data();
-            uint32_t kmer = sequence[0];
-            for (uint32_t k = 1; k < kmer_offset; ++k) {
-                kmer = (kmer << kProtBits) | sequence[k];
+            /* a target shorter than the span has no kmers and scores 0 */
+            if (target->length() >= span && kSeed) {
+                ScanTarget<kSeed, kBits>::run(scores.data(), max_score.get(),
+                    score_starts.get(), *hash, kSeed, kBits, 0,
+                    target->length() - span, *target, residue_map,
+                    kmer_buffer);
+            } else if (target->length() >= span) {
+                for (uint32_t s = 0; s < scan_target_functions.size(); ++s) {
+                    scan_target_functions[s](scores.data(), max_score.get(),
+                        score_starts.get(), *hash, kmers->seeds()[s],
+                        kmers->residue_bits(), s * kmers->num_kmers(),
+                        target->length() - span, *target, residue_map,
+                        kmer_buffer);
+                }
             }
 
-            uint32_t max_diag_id = database[j]->length() - kmer_length;
-            for (uint32_t k = kmer_offset; k < sequence.size(); ++k) {
-                kmer = ((kmer << kProtBits) | sequence[k]) & del_mask;
-                hash->hits(begin, end, kmer);
-                for (; begin != end; ++begin) {
-                    auto diagonal = max_diag_id + kmer_offset - k +
-                        begin->position() + score_starts[begin->id()];
-                    ++scores[diagonal];
-                    if (max_score[begin->id()] < scores[diagonal]) {
-                        max_score[begin->id()] = scores[diagonal];
-                    }
+            /* copies are part of the background as if they were searched */
+            uint32_t num_copies = 1;
+            if (!database_copies.empty()) {
+                for (auto c = database_copies[database_order[j]]; c != kNoCopy;
+                    c = database_copies[c]) {
+                    ++num_copies;
                 }
             }
 
             for (uint32_t k = 0; k < group_length; ++k) {
 
+                histograms_part[k].add(max_score[k], num_copies);
+
                 if (max_score[k] <= min_score) {
                     continue;
                 }
 
-                auto id = queries[i + k]->id();
+                auto id = queries[queries_order[i + k]]->id();
                 auto flag = entries_part[id].size() < max_candidates &&
-                    entries_found[k] < max_candidates;
+                    entries_found[i + k] < max_candidates;
+
+                if (flag || max_score[k] >= min_entry_score[i + k]) {
 
-                if (flag || max_score[k] >= min_entry_score[k]) {
+                    entries_part[id].emplace_back(target->id(), max_score[k],
+                        target->length());
 
-                    entries_part[id].emplace_back(database[j]->id(), max_score[k]);
+                    if (!database_copies.empty()) {
+                        for (auto c = database_copies[database_order[j]];
+                            c != kNoCopy; c = database_copies[c]) {
+                            entries_part[id].emplace_back(database[c]->id(),
+                                max_score[k], target->length());
+                        }
+                    }
 
-                    if (min_entry_score[k] > max_score[k]) {
-                        min_entry_score[k] = max_score[k];
+                    if (min_entry_score[i + k] > max_score[k]) {
+                        min_entry_score[i + k] = max_score[k];
                     }
                 }
             }
@@ -249,9 +537,11 @@ void scoreChains(ChainEntrySet& dst, std::vector<MutexPtr>& entry_mutexes,
 
         {
             for (uint32_t k = 0; k < group_length; ++k) {
-                auto id = queries[i + k]->id();
+                auto id = queries[queries_order[i + k]]->id();
                 std::unique_lock<std::mutex> lock(*(entry_mutexes[id].get()));
 
+                histograms[id].add(histograms_part[k]);
+
                 dst[id].insert(dst[id].end(), entries_part[id].begin(),
                     entries_part[id].end());
                 std::vector<ChainEntry>().swap(entries_part[id]);
@@ -276,78 +566,334 @@ void scoreChains(ChainEntrySet& dst, std::vector<MutexPtr>& entry_mutexes,
         database_start, database_end, max_target_length, groups, time_ / (double) 1000000);
 }
 
-uint64_t searchDatabase(Indexes& dst, const std::string& database_path,
-    const std::string& queries_path, uint32_t kmer_length, uint32_t max_candidates,
-    std::shared_ptr<ScoreMatrix> score_matrix, uint32_t score_threshold,
+template<uint32_t kSeed, uint32_t kBits>
+struct ScoreChains {
+
+    static void run(ChainEntrySet& dst, std::vector<MutexPtr>& entry_mutexes,
+        ScoreHistogramSet& histograms, size_t max_candidates, const ChainSet& queries,
+        const std::vector<uint32_t>& queries_order, const ChainSet& database,
+        const std::vector<uint32_t>& database_order,
+        const std::vector<uint32_t>& database_copies, uint32_t database_start,
+        uint32_t database_end, std::shared_ptr<Kmers> kmers) {
+
+        scoreChains<kSeed, kBits>(dst, entry_mutexes, histograms,
+            max_candidates, queries,
+            queries_order, database, database_order, database_copies,
+            database_start, database_end, kmers);
+    }
+};
+
+using ScoreChainsFunction = decltype(&ScoreChains<0, 0>::run);
+
+/* picked once per search, kmers with more than one seed use the generic
+ * kernel (which scans with specialized seeds) */
+ScoreChainsFunction scoreChainsFunction(std::shared_ptr<Kmers> kmers) {
+
+    if (kmers->seeds().size() != 1) {
+        return ScoreChains<0, 0>::run;
+    }
+
+    return specializeSeed<ScoreChains>(kmers->seeds().front(),
+        kmers->residue_bits());
+}
+
+void searchDatabasePart(ChainEntrySet& entries, std::vector<MutexPtr>& entry_mutexes,
+    ScoreHistogramSet& histograms, uint32_t max_candidates, const ChainSet& queries,
+    const std::vector<uint32_t>& queries_order, const ChainSet& database,
+    const std::vector<uint32_t>& database_order,
+    const std::vector<uint32_t>& database_copies,
+    const std::vector<uint32_t>& database_tasks, std::shared_ptr<Kmers> kmers,
+    ScoreChainsFunction score_chains,
     std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
 
-    ChainSet queries;
-    createChainSet(queries, queries_path);
+    std::vector<std::future<void>> thread_futures;
 
-    sort(queries.begin(), queries.end(), compareChainByLengthAsc);
+    for (uint32_t i = 0; i < database_tasks.size() - 1; ++i) {
+        thread_futures.emplace_back(thread_pool->submit(score_chains,
+            std::ref(entries), std::ref(entry_mutexes), std::ref(histograms),
+            max_candidates,
+            std::cref(queries), std::cref(queries_order), std::cref(database),
+            std::cref(database_order), std::cref(database_copies),
+            database_tasks[i], database_tasks[i + 1], kmers));
+    }
+
+    for (const auto& it: thread_futures) {
+        it.wait();
+    }
+}
+
+/* entries are sorted by score, if zscore is greater than 0 candidates of
+ * each query are cut at the cutoff of its score histogram */
+void createIndexes(Indexes& dst, const ChainEntrySet& entries,
+    const ScoreHistogramSet& histograms, double zscore) {
+
+    dst.clear();
+    dst.resize(entries.size());
+
+    size_t num_candidates = 0, num_kept = 0;
+
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+
+        uint32_t cutoff = zscore > 0 ? histograms[i].cutoff(zscore) : 0;
+
+        dst[i].reserve(entries[i].size());
+
+        for (const auto& it: entries[i]) {
+            if (it.data() < cutoff) {
+                break;
+            }
+            dst[i].emplace_back(it.chain_idx());
+        }
+
+        num_candidates += entries[i].size();
+        num_kept += dst[i].size();
+
+        std::sort(dst[i].begin(), dst[i].end());
+    }
+
+    if (zscore > 0) {
+        fprintf(stderr, "[sword::] keeping %zu of %zu candidates above the "
+            "score background\n", num_kept, num_candidates);
+    }
+}
+
+/* searches targets with id % num_shards == shard, returns the number of
+ * residues of all targets; database gets the searched chains if they were read
+ * as a single part (and search_part is not set) */
+uint64_t searchDatabaseFile(ChainEntrySet& entries, ScoreHistogramSet& histograms,
+    ChainSet& database, const std::string& database_path, ChainSet& queries,
+    std::shared_ptr<Kmers> kmers, uint32_t max_candidates,
+    bool remove_duplicates, bool mask_low_complexity, uint32_t shard,
+    uint32_t num_shards, SearchPartFunction search_part,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    if (mask_low_complexity) {
+        maskLowComplexity(queries, 0, thread_pool);
+    }
 
-    std::shared_ptr<Kmers> kmers = createKmers(kmer_length, score_threshold,
-        score_matrix);
+    std::vector<uint32_t> queries_order;
+    sortQueries(queries_order, queries);
 
     uint64_t database_cells = 0;
-    std::shared_ptr<Reader> reader = createChainSetPartInitialize(database_path);
+    std::shared_ptr<Reader> reader = createChainSetPartInitialize(database_path,
+        thread_pool);
 
-    ChainEntrySet entries(queries.size());
+    entries.resize(queries.size());
+    histograms.resize(queries.size());
     std::vector<MutexPtr> entry_mutexes;
     for (uint32_t i = 0; i < queries.size(); ++i) {
         entry_mutexes.push_back(MutexPtr(new std::mutex()));
     }
 
+    auto score_chains = scoreChainsFunction(kmers);
+
+    database.clear();
+    bool is_first_part = true;
+
     Timer timer;
     while (true) {
 
         ChainSet database_part;
-        auto status = createChainSetPart(database_part, reader, kDatabasePartSize);
+        auto status = createChainSetPart(database_part, reader,
+            databasePartSize(memory));
 
-        std::vector<uint32_t> tasks;
-        preprocDatabase(tasks, database_part, thread_pool->num_threads());
-
-        timer.start();
+        for (const auto& it: database_part) {
+            database_cells += it->length();
+        }
 
-        std::vector<std::future<void>> thread_futures;
+        if (num_shards > 1) {
+            database_part.erase(std::remove_if(database_part.begin(),
+                database_part.end(), [&](const std::unique_ptr<Chain>& it) {
+                    return it->id() % num_shards != shard;
+                }), database_part.end());
+        }
 
-        for (uint32_t i = 0; i < tasks.size() - 1; ++i) {
-            thread_futures.emplace_back(thread_pool->submit(scoreChains,
-                std::ref(entries), std::ref(entry_mutexes), max_candidates,
-                std::ref(queries), std::ref(database_part), tasks[i],
-                tasks[i + 1], kmers));
+        if (mask_low_complexity) {
+            maskLowComplexity(database_part, 0, thread_pool);
         }
 
-        for (const auto& it: thread_futures) {
-            it.wait();
+        uint64_t part_memory = 0;
+        if (memory) {
+            part_memory = chainSetMemory(database_part);
+            memory->reserve(part_memory);
         }
 
+        std::vector<uint32_t> database_order;
+        std::vector<uint32_t> database_copies;
+        std::vector<uint32_t> tasks;
+        preprocDatabase(database_order, tasks, database_copies, database_part,
+            thread_pool->num_threads(), remove_duplicates);
+
+        timer.start();
+
+        searchDatabasePart(entries, entry_mutexes, histograms, max_candidates,
+            queries, queries_order, database_part, database_order, database_copies,
+            tasks, kmers, score_chains, thread_pool);
+
         timer.stop();
 
-        for (const auto& it: database_part) {
-            database_cells += it->length();
+        if (search_part && !database_part.empty()) {
+
+            /* targets of the part which are candidates of a query so far */
+            auto first_id = database_part.front()->id();
+            auto last_id = database_part.back()->id();
+
+            Indexes candidates(queries.size());
+            for (uint32_t i = 0; i < queries.size(); ++i) {
+                for (const auto& it: entries[i]) {
+                    if (it.chain_idx() >= first_id && it.chain_idx() <= last_id) {
+                        candidates[i].emplace_back(it.chain_idx());
+                    }
+                }
+                std::sort(candidates[i].begin(), candidates[i].end());
+            }
+
+            search_part(database_part, candidates);
+        }
+
+        if (memory) {
+            memory->release(part_memory);
         }
 
         if (status == false) {
+            if (is_first_part && num_shards <= 1 && !search_part) {
+                database.swap(database_part);
+            }
             break;
         }
+        is_first_part = false;
     }
 
     timer.print("database", "search-werk");
 
-    dst.clear();
-    dst.resize(queries.size());
+    return database_cells;
+}
 
-    for (uint32_t i = 0; i < queries.size(); ++i) {
+uint64_t searchDatabase(Indexes& dst, ChainSet& database,
+    const std::string& database_path, ChainSet& queries,
+    std::shared_ptr<Kmers> kmers, uint32_t max_candidates, double candidates_zscore,
+    bool remove_duplicates, bool mask_low_complexity,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
 
-        dst[i].reserve(entries[i].size());
+    ChainEntrySet entries;
+    ScoreHistogramSet histograms;
+
+    auto database_cells = searchDatabaseFile(entries, histograms, database,
+        database_path, queries, kmers, max_candidates, remove_duplicates,
+        mask_low_complexity, 0, 1, nullptr, memory, thread_pool);
+
+    createIndexes(dst, entries, histograms, candidates_zscore);
+
+    return database_cells;
+}
+
+uint64_t searchDatabase(ChainSet& queries, const std::string& database_path,
+    std::shared_ptr<Kmers> kmers, uint32_t max_candidates,
+    bool remove_duplicates, bool mask_low_complexity,
+    SearchPartFunction search_part, std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    ChainEntrySet entries;
+    ScoreHistogramSet histograms;
+    ChainSet database;
+
+    return searchDatabaseFile(entries, histograms, database, database_path,
+        queries, kmers, max_candidates, remove_duplicates, mask_low_complexity,
+        0, 1, search_part, memory, thread_pool);
+}
+
+uint64_t searchDatabase(CandidateSet& dst, const std::string& database_path,
+    const std::string& queries_path, std::shared_ptr<Kmers> kmers,
+    uint32_t max_candidates, bool remove_duplicates, bool mask_low_complexity,
+    uint32_t shard, uint32_t num_shards, std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    assert(shard < num_shards);
+
+    ChainSet queries;
+    createChainSet(queries, queries_path, thread_pool);
+
+    ChainEntrySet entries;
+    ScoreHistogramSet histograms;
+    ChainSet database;
 
+    auto database_cells = searchDatabaseFile(entries, histograms, database,
+        database_path, queries, kmers, max_candidates, remove_duplicates,
+        mask_low_complexity, shard, num_shards, nullptr, memory, thread_pool);
+
+    dst.clear();
+    dst.resize(entries.size());
+
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        dst[i].entries.reserve(entries[i].size());
         for (const auto& it: entries[i]) {
-            dst[i].emplace_back(it.chain_idx());
+            dst[i].entries.push_back({it.chain_idx(), it.data(), it.length()});
+        }
+        dst[i].histogram.resize(kHistogramBins);
+        for (uint32_t j = 0; j < kHistogramBins; ++j) {
+            dst[i].histogram[j] = histograms[i].count(j);
         }
-
-        std::sort(dst[i].begin(), dst[i].end());
     }
 
     return database_cells;
 }
+
+void mergeCandidates(std::vector<uint32_t>& dst,
+    const std::vector<QueryCandidates>& parts, uint32_t max_candidates,
+    double candidates_zscore) {
+
+    ChainEntrySet entries(1);
+    ScoreHistogramSet histograms(1);
+
+    for (const auto& it: parts) {
+        for (const auto& entry: it.entries) {
+            entries[0].emplace_back(entry.id, entry.score, entry.length);
+        }
+        for (uint32_t i = 0; i < it.histogram.size(); ++i) {
+            histograms[0].add(i, it.histogram[i]);
+        }
+    }
+
+    std::sort(entries[0].begin(), entries[0].end(), compareChainEntryDsc);
+    if (entries[0].size() > max_candidates) {
+        entries[0].resize(max_candidates);
+    }
+
+    uint32_t cutoff = candidates_zscore > 0 ?
+        histograms[0].cutoff(candidates_zscore) : 0;
+
+    dst.clear();
+    for (const auto& it: entries[0]) {
+        if (it.data() < cutoff) {
+            break;
+        }
+        dst.emplace_back(it.chain_idx());
+    }
+
+    std::sort(dst.begin(), dst.end());
+}
+
+void searchDatabase(Indexes& dst, const ChainSet& queries,
+    std::shared_ptr<Database> database, uint32_t max_candidates,
+    double candidates_zscore, std::shared_ptr<Kmers> kmers,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    std::vector<uint32_t> queries_order;
+    sortQueries(queries_order, queries);
+
+    ChainEntrySet entries(queries.size());
+    ScoreHistogramSet histograms(queries.size());
+    std::vector<MutexPtr> entry_mutexes;
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        entry_mutexes.push_back(MutexPtr(new std::mutex()));
+    }
+
+    searchDatabasePart(entries, entry_mutexes, histograms, max_candidates,
+        queries, queries_order, database->chains(), database->search_order(),
+        database->copies(), database->search_tasks(), kmers,
+        scoreChainsFunction(kmers), thread_pool);
+
+    createIndexes(dst, entries, histograms, candidates_zscore);
+}
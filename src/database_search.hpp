@@ -10,14 +10,127 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "thread_pool/thread_pool.hpp"
 
-class ScoreMatrix;
+class Chain;
+class Kmers;
+class Database;
+class MemoryAccountant;
 
+using ChainSet = std::vector<std::unique_ptr<Chain>>;
 using Indexes = std::vector<std::vector<uint32_t>>;
 
-uint64_t searchDatabase(Indexes& dst, const std::string& database_path,
-    const std::string& queries_path, uint32_t kmer_length, uint32_t max_candidates,
-    std::shared_ptr<ScoreMatrix> score_matrix, uint32_t score_threshold,
+constexpr uint32_t kNoCopy = UINT32_MAX;
+
+/*!
+ * @brief Sorts positions of database chains by length into order and splits
+ * them into dst so that each of the [dst[i], dst[i + 1]) tasks has a similar
+ * number of residues (short and long chains are never mixed)
+ * @details If remove_duplicates is set, only the first of chains with
+ * identical data is put into order; copies[i] is then the position of the
+ * next chain with the same data as database[i] (or kNoCopy), otherwise copies
+ * is empty.
+ */
+void preprocDatabase(std::vector<uint32_t>& order, std::vector<uint32_t>& dst,
+    std::vector<uint32_t>& copies, const ChainSet& database, size_t num_threads,
+    bool remove_duplicates);
+
+/*!
+ * @brief Searches queries (with ids 0, ..., queries.size() - 1) against the
+ * database read from database_path part by part (parts are sized by memory if
+ * it is set, see MemoryAccountant); identical queries are searched only once,
+ * dst[i] is empty for a query which is a duplicate of an earlier query (see
+ * findDuplicateChains);
+ * identical targets are searched only once if remove_duplicates is set (and
+ * are all reported as candidates); if mask_low_complexity is set, kmers in low
+ * complexity regions of queries and targets are ignored (see
+ * maskLowComplexity)
+ * @details At most max_candidates targets are kept for each query; if
+ * candidates_zscore is greater than 0, only those whose diagonal score lies at
+ * least candidates_zscore standard deviations above the mean score of all
+ * targets against the query are kept. If the database is read as a single
+ * part, its chains are moved to database (database[i]->id() == i) so that they
+ * can be aligned without reading the file again, otherwise database is empty.
+ * Returns the number of residues of the database.
+ */
+uint64_t searchDatabase(Indexes& dst, ChainSet& database,
+    const std::string& database_path, ChainSet& queries,
+    std::shared_ptr<Kmers> kmers, uint32_t max_candidates, double candidates_zscore,
+    bool remove_duplicates, bool mask_low_complexity,
+    std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+/*!
+ * @brief Called after a part of the database is searched with its chains
+ * (which can be moved out) and, for each query, the sorted ids of the targets
+ * of the part which are among its candidates so far
+ */
+using SearchPartFunction = std::function<void(ChainSet& database_part,
+    const Indexes& candidates)>;
+
+/*!
+ * @brief Searches queries (see above) against the database read from
+ * database_path part by part and calls search_part after each part, so that
+ * candidates can be processed while the part is in memory; targets of a part
+ * can still be replaced by better ones of later parts. Returns the number of
+ * residues of the database.
+ */
+uint64_t searchDatabase(ChainSet& queries, const std::string& database_path,
+    std::shared_ptr<Kmers> kmers, uint32_t max_candidates,
+    bool remove_duplicates, bool mask_low_complexity,
+    SearchPartFunction search_part, std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+struct Candidate {
+    uint32_t id;
+    uint32_t score; // diagonal score
+    uint32_t length; // target length, shorter targets win ties
+};
+
+/*!
+ * @brief Candidates of a query, best first (ties by target length and id),
+ * and the histogram of diagonal scores of all searched targets (the last bin
+ * holds all higher scores)
+ */
+struct QueryCandidates {
+    std::vector<Candidate> entries;
+    std::vector<uint32_t> histogram;
+};
+
+using CandidateSet = std::vector<QueryCandidates>;
+
+/*!
+ * @brief Searches only targets whose id (position in the database) modulo
+ * num_shards equals shard, dst[i] contains the best max_candidates targets of
+ * the shard for query with id i; returns the number of residues of the whole
+ * database
+ * @details Candidates of all shards of a query give the same candidates as
+ * searching the whole database (see mergeCandidates).
+ */
+uint64_t searchDatabase(CandidateSet& dst, const std::string& database_path,
+    const std::string& queries_path, std::shared_ptr<Kmers> kmers,
+    uint32_t max_candidates, bool remove_duplicates, bool mask_low_complexity,
+    uint32_t shard, uint32_t num_shards, std::shared_ptr<MemoryAccountant> memory,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+/*!
+ * @brief Sets dst to the sorted ids of the candidates of a query which
+ * searchDatabase would keep for the whole database, given candidates of the
+ * query found in each shard of it
+ */
+void mergeCandidates(std::vector<uint32_t>& dst,
+    const std::vector<QueryCandidates>& parts, uint32_t max_candidates,
+    double candidates_zscore);
+
+/*!
+ * @brief Searches in-memory queries (with ids 0, ..., queries.size() - 1)
+ * against a resident database, dst[i] contains candidates for query with id i
+ * (empty for duplicate queries); low complexity regions are ignored if they
+ * were found for the chains beforehand
+ */
+void searchDatabase(Indexes& dst, const ChainSet& queries,
+    std::shared_ptr<Database> database, uint32_t max_candidates,
+    double candidates_zscore, std::shared_ptr<Kmers> kmers,
     std::shared_ptr<thread_pool::ThreadPool> thread_pool);
@@ -6,6 +6,7 @@
 
 #include <math.h>
 #include <vector>
+#include <algorithm>
 
 #include "chain.hpp"
 #include "reader.hpp"
@@ -39,6 +40,14 @@ std::vector<EValueConstants> kEValueConstants = {
     { 9, 1, 0.206, 0.010, 0.052, 4.0, 0.731887, 210.333000, 214.842000 }
 };
 
+/* scores are never searched beyond this value in min_score */
+constexpr int32_t kMaxScore = 1 << 24;
+
+/* lengths below 64 have their own bin, longer lengths in [2^k, 2^(k + 1))
+ * share bins of width 2^(k - 5) */
+constexpr uint32_t kBinBits = 5;
+constexpr uint32_t kNumBins = 32 * 64;
+
 std::unique_ptr<EValue> createEValue(uint64_t database_cells,
     std::shared_ptr<ScoreMatrix> scorer) {
 
@@ -91,13 +100,65 @@ EValue::EValue(uint64_t database_cells, std::shared_ptr<ScoreMatrix> scorer) {
 double EValue::calculate(int32_t score, uint32_t query_length,
     uint32_t target_length) const {
 
+    return bound(score, query_length, target_length, target_length);
+}
+
+void EValue::calculate(std::vector<double>& dst, const std::vector<int32_t>& scores,
+    uint32_t query_length, const std::vector<uint32_t>& target_lengths) const {
+
+    dst.resize(scores.size());
+    for (uint32_t i = 0; i < scores.size(); ++i) {
+        dst[i] = bound(scores[i], query_length, target_lengths[i], target_lengths[i]);
+    }
+}
+
+int32_t EValue::min_score(double max_evalue, uint32_t query_length,
+    uint32_t min_target_length, uint32_t max_target_length) const {
+
+    auto reaches = [&](int32_t score) -> bool {
+        return bound(score, query_length, min_target_length, max_target_length) <=
+            max_evalue;
+    };
+
+    /* scores can be negative (e.g. of global alignments) */
+    if (reaches(0)) {
+        return INT32_MIN;
+    }
+
+    int32_t high = 1;
+    while (!reaches(high)) {
+        if (high >= kMaxScore) {
+            return kMaxScore;
+        }
+        high *= 2;
+    }
+
+    /* reaches(low) is false and reaches(high) is true */
+    int32_t low = high / 2;
+    while (high - low > 1) {
+        auto mid = low + (high - low) / 2;
+        if (reaches(mid)) {
+            high = mid;
+        } else {
+            low = mid;
+        }
+    }
+
+    return high;
+}
+
+double EValue::bound(int32_t score, uint32_t query_length,
+    uint32_t min_target_length, uint32_t max_target_length) const {
+
     /* Code taken from SW# (author Matija Korpar) which was take from BLAST */
     int y_ = score;
     int m_ = query_length;
-    int n_ = target_length;
+    int n_ = min_target_length;
 
-    /* The pair-wise e-value must be scaled back to db-wise e-value*/
-    double db_scale_factor = (double) length_ / (double) n_;
+    /* The pair-wise e-value must be scaled back to db-wise e-value; the
+     * area grows and the scale shrinks with the target length, so the
+     * shortest and the longest length of a range give a lower bound */
+    double db_scale_factor = (double) length_ / (double) max_target_length;
 
     double k_         = K_;
     double ai_hat_    = a_;
@@ -139,3 +200,25 @@ double EValue::calculate(int32_t score, uint32_t query_length,
 
     return area * k_ * exp(-lambda_ * y_) * db_scale_factor;
 }
+
+ScoreThresholds::ScoreThresholds(const EValue& evalue, double max_evalue,
+    uint32_t query_length)
+        : evalue_(evalue), max_evalue_(max_evalue), query_length_(query_length),
+        min_scores_(kNumBins, -1) {
+}
+
+int32_t ScoreThresholds::min_score(uint32_t target_length) {
+
+    uint32_t log_length = 31 - __builtin_clz(target_length | 1);
+    uint32_t shift = log_length > kBinBits ? log_length - kBinBits : 0;
+    uint32_t bin = shift * 64 + (target_length >> shift);
+
+    if (min_scores_[bin] == -1) {
+        uint32_t min_length = (target_length >> shift) << shift;
+        uint32_t max_length = min_length + (1U << shift) - 1;
+        min_scores_[bin] = evalue_.min_score(max_evalue_, query_length_,
+            std::max(min_length, 1U), max_length);
+    }
+
+    return min_scores_[bin];
+}
@@ -9,8 +9,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <memory>
+#include <vector>
 
 enum class ScoreMatrixType;
+class ScoreMatrix;
 class EValue;
 
 std::unique_ptr<EValue> createEValue(uint64_t database_cells,
@@ -23,6 +25,21 @@ public:
 
     double calculate(int32_t score, uint32_t query_length, uint32_t target_length) const;
 
+    /*!
+     * @brief Evalues of scores of a query against targets of given lengths
+     */
+    void calculate(std::vector<double>& dst, const std::vector<int32_t>& scores,
+        uint32_t query_length, const std::vector<uint32_t>& target_lengths) const;
+
+    /*!
+     * @brief Lowest score which can reach max_evalue against any target with
+     * length in [min_target_length, max_target_length]
+     * @details Evalues decrease with the score, therefore all lower scores
+     * have evalues above max_evalue.
+     */
+    int32_t min_score(double max_evalue, uint32_t query_length,
+        uint32_t min_target_length, uint32_t max_target_length) const;
+
     friend std::unique_ptr<EValue> createEValue(uint64_t database_cells,
         std::shared_ptr<ScoreMatrix> scorer);
 
@@ -33,6 +50,12 @@ private:
     EValue(const EValue&) = delete;
 	const EValue& operator=(const EValue&) = delete;
 
+    /* a lower bound of evalues against targets with lengths in
+     * [min_target_length, max_target_length], equal to the evalue if the
+     * lengths are equal */
+    double bound(int32_t score, uint32_t query_length, uint32_t min_target_length,
+        uint32_t max_target_length) const;
+
     double lambda_;
     double K_;
     double logK_;
@@ -49,3 +72,30 @@ private:
     double alphaUn_;
     uint64_t length_;
 };
+
+/*!
+ * @brief Lowest scores which reach max_evalue for a query, cached by bins of
+ * target lengths (each spanning at most 1/32 of its lengths) so that most
+ * alignments are rejected by comparing scores instead of computing evalues
+ */
+class ScoreThresholds {
+public:
+
+    ScoreThresholds(const EValue& evalue, double max_evalue, uint32_t query_length);
+    ~ScoreThresholds() = default;
+
+    /*!
+     * @brief Alignments with lower scores have evalues above max_evalue
+     */
+    int32_t min_score(uint32_t target_length);
+
+private:
+
+    ScoreThresholds(const ScoreThresholds&) = delete;
+    const ScoreThresholds& operator=(const ScoreThresholds&) = delete;
+
+    const EValue& evalue_;
+    double max_evalue_;
+    uint32_t query_length_;
+    std::vector<int32_t> min_scores_;
+};
@@ -6,44 +6,70 @@
 
 #include <assert.h>
 #include <queue>
+#include <algorithm>
 
 #include "chain.hpp"
 #include "kmers.hpp"
 #include "hash.hpp"
 
-std::vector<uint32_t> kNumDiffKmers = { 0, 0, 0, 26427, 845627, 27060027 };
-
 Hit::Hit(uint32_t id, uint32_t position)
-        : id_(id), position_(position) {
+        : data_((position << kHitIdBits) | id) {
 }
 
-std::unique_ptr<Hash> createHash(const ChainSet& chains, uint32_t start,
-    uint32_t length, std::shared_ptr<Kmers> kmers) {
+std::unique_ptr<Hash> createHash(const ChainSet& chains,
+    const std::vector<uint32_t>& order, uint32_t start, uint32_t length,
+    std::shared_ptr<Kmers> kmers) {
 
     assert(chains.size());
-    assert(start < chains.size() && start + length <= chains.size());
+    assert(start < order.size() && start + length <= order.size());
+    assert(length <= kMaxHashChains);
     assert(kmers);
 
-    return std::unique_ptr<Hash>(new Hash(chains, start, length, kmers));
+    return std::unique_ptr<Hash>(new Hash(chains, order, start, length, kmers));
 }
 
-Hash::Hash(const ChainSet& chains, uint32_t start, uint32_t length,
-    std::shared_ptr<Kmers> kmers)
-        : starts_(kNumDiffKmers[kmers->kmer_length()], 0) {
+Hash::Hash(const ChainSet& chains, const std::vector<uint32_t>& order,
+    uint32_t start, uint32_t length, std::shared_ptr<Kmers> kmers)
+        : starts_(kmers->num_kmers() * kmers->seeds().size() + 2, 0),
+        hits_(), occupancy_((starts_.size() + 63) / 64, 0) {
 
-    for (uint32_t i = start; i < start + length; ++i) {
+    /* kmers of different seeds are kept apart by offsetting their codes, the
+     * last key is left empty (see masked_key) */
+    uint32_t num_seeds = kmers->seeds().size();
+    uint32_t masked = kmers->num_kmers();
+    std::vector<uint32_t> kmer_vector;
 
-        auto kmer_vector = createKmerVector(chains[i], kmers->kmer_length());
+    auto create_kmer_vector = [&](uint32_t i, uint32_t s) {
+        const auto& chain = chains[order[i]];
+        kmers->kmer_vector(kmer_vector, chain->data(), s);
+        maskKmers(kmer_vector.data(), kmer_vector.size(), chain->low_complexity(),
+            seedSpan(kmers->seeds()[s]), masked);
+    };
 
-        for (uint32_t j = 0; j < kmer_vector.size(); ++j) {
-            ++starts_[kmer_vector[j] + 1];
-            for (const auto& it: kmers->kmer_substitutions(kmer_vector[j])) {
-                ++starts_[it + 1];
+    for (uint32_t i = start; i < start + length; ++i) {
+        for (uint32_t s = 0; s < num_seeds; ++s) {
+
+            create_kmer_vector(i, s);
+            auto offset = s * kmers->num_kmers();
+            uint32_t num_positions = std::min<size_t>(kmer_vector.size(),
+                kMaxHitPosition + 1);
+
+            for (uint32_t j = 0; j < num_positions; ++j) {
+                if (kmer_vector[j] == masked) {
+                    continue;
+                }
+                ++starts_[offset + kmer_vector[j] + 1];
+                for (const auto& it: kmers->kmer_substitutions(kmer_vector[j])) {
+                    ++starts_[offset + it + 1];
+                }
             }
         }
     }
 
-    for (uint32_t i = 1; i < starts_.size() - 1; ++i) {
+    for (uint32_t i = 0; i < starts_.size() - 1; ++i) {
+        if (starts_[i + 1] != 0) {
+            occupancy_[i >> 6] |= 1ULL << (i & 63);
+        }
         starts_[i + 1] += starts_[i];
     }
 
@@ -51,16 +77,25 @@ Hash::Hash(const ChainSet& chains, uint32_t start, uint32_t length,
     std::vector<uint32_t> tmp(starts_.begin(), starts_.end());
 
     for (uint32_t i = start; i < start + length; ++i) {
+        for (uint32_t s = 0; s < num_seeds; ++s) {
+
+            create_kmer_vector(i, s);
+            auto offset = s * kmers->num_kmers();
+            uint32_t num_positions = std::min<size_t>(kmer_vector.size(),
+                kMaxHitPosition + 1);
 
-        auto kmer_vector = createKmerVector(chains[i], kmers->kmer_length());
+            for (uint32_t j = 0; j < num_positions; ++j) {
 
-        for (uint32_t j = 0; j < kmer_vector.size(); ++j) {
+                if (kmer_vector[j] == masked) {
+                    continue;
+                }
 
-            auto hit = Hit(i - start, j);
-            hits_[tmp[kmer_vector[j]]++] = hit;
+                auto hit = Hit(i - start, j);
+                hits_[tmp[offset + kmer_vector[j]]++] = hit;
 
-            for (const auto& it: kmers->kmer_substitutions(kmer_vector[j])) {
-                hits_[tmp[it]++] = hit;
+                for (const auto& it: kmers->kmer_substitutions(kmer_vector[j])) {
+                    hits_[tmp[offset + it]++] = hit;
+                }
             }
         }
     }
@@ -16,6 +16,15 @@ class Hash;
 
 using ChainSet = std::vector<std::unique_ptr<Chain>>;
 
+/*!
+ * @brief Hits are packed into 32 bits, the lower kHitIdBits hold the id of the
+ * chain (relative to the start of the hashed group) and the rest the position
+ * of the kmer in the chain
+ */
+constexpr uint32_t kHitIdBits = 12;
+constexpr uint32_t kMaxHashChains = 1U << kHitIdBits;
+constexpr uint32_t kMaxHitPosition = (1U << (32 - kHitIdBits)) - 1;
+
 class Hit {
 public:
 
@@ -24,21 +33,29 @@ public:
     ~Hit() = default;
 
     uint32_t id() const {
-        return id_;
+        return data_ & (kMaxHashChains - 1);
     }
 
     uint32_t position() const {
-        return position_;
+        return data_ >> kHitIdBits;
     }
 
 private:
 
-    uint32_t id_;
-    uint32_t position_;
+    uint32_t data_;
 };
 
-std::unique_ptr<Hash> createHash(const ChainSet& chains, uint32_t start,
-    uint32_t length, std::shared_ptr<Kmers> kmers);
+/*!
+ * @brief Indexes kmers of chains[order[start]], ..., chains[order[start +
+ * length - 1]], ids of hits are relative to start; kmers of the i-th seed
+ * are stored under their code + i * kmers->num_kmers()
+ * @details At most kMaxHashChains chains can be indexed, kmers beginning
+ * after kMaxHitPosition and kmers overlapping low complexity regions of chains
+ * are left out.
+ */
+std::unique_ptr<Hash> createHash(const ChainSet& chains,
+    const std::vector<uint32_t>& order, uint32_t start, uint32_t length,
+    std::shared_ptr<Kmers> kmers);
 
 class Hash {
 public:
@@ -48,17 +65,61 @@ public:
     using Iterator = std::vector<Hit>::iterator;
     void hits(Iterator& start, Iterator& end, uint32_t key);
 
+    /*!
+     * @brief Checks if there are any hits for key, uses a bitmap which is a
+     * lot smaller than the bucket offsets (and more likely to be cached)
+     */
+    bool has_hits(uint32_t key) const {
+        return (occupancy_[key >> 6] >> (key & 63)) & 1;
+    }
+
+    /*!
+     * @brief Key which never has any hits, used for masked kmers
+     */
+    uint32_t masked_key() const {
+        return starts_.size() - 2;
+    }
+
+    /*!
+     * @brief Prefetches the occupancy bits and bucket offsets of key, used
+     * some kmers ahead of the lookup
+     */
+    void prefetch_offsets(uint32_t key) const {
+        prefetch(&occupancy_[key >> 6]);
+        prefetch(&starts_[key]);
+    }
+
+    /*!
+     * @brief Prefetches the first hits of key (offsets should be prefetched
+     * before with prefetch_offsets)
+     */
+    void prefetch_hits(uint32_t key) const {
+        if (has_hits(key)) {
+            prefetch(&hits_[starts_[key]]);
+        }
+    }
+
     friend std::unique_ptr<Hash> createHash(const ChainSet& chains,
-        uint32_t start, uint32_t length, std::shared_ptr<Kmers> kmers);
+        const std::vector<uint32_t>& order, uint32_t start, uint32_t length,
+        std::shared_ptr<Kmers> kmers);
 
 private:
 
-    Hash(const ChainSet& chains, uint32_t start, uint32_t length,
-        std::shared_ptr<Kmers> kmers);
+    static void prefetch(const void* address) {
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#else
+        (void) address;
+#endif
+    }
+
+    Hash(const ChainSet& chains, const std::vector<uint32_t>& order,
+        uint32_t start, uint32_t length, std::shared_ptr<Kmers> kmers);
 
     Hash(const Hash&) = delete;
     const Hash& operator=(const Hash&) = delete;
 
-    std::vector<size_t> starts_;
+    std::vector<uint32_t> starts_;
     std::vector<Hit> hits_;
+    std::vector<uint64_t> occupancy_;
 };
@@ -0,0 +1,562 @@
+/*!
+ * @file index.cpp
+ *
+ * @brief Index class source file
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
+#include "thread_pool/thread_pool.hpp"
+
+#include "chain.hpp"
+#include "reader.hpp"
+#include "input_stream.hpp"
+#include "index.hpp"
+
+/* All values are stored in native byte order:
+ *     header:  magic (4 bytes), format (uint32)
+ *     record:  type (uint32), version (uint32), payload size (uint64), payload
+ *     block payload:  num_chains (uint32), num_residues (uint64), chains as
+ *         name length (uint32), name, data length (uint32), data
+ *     tombstone payload:  num_ids (uint32), ids as length (uint32), id;
+ *         num_blocks (uint32), blocks as version (uint32), num_chains
+ *         (uint32), num_residues (uint64) which were removed from them */
+
+constexpr char kIndexMagic[] = {'S', 'W', 'I', 'X'};
+constexpr uint32_t kIndexFormat = 1;
+constexpr uint64_t kHeaderSize = sizeof(kIndexMagic) + sizeof(uint32_t);
+constexpr uint64_t kRecordHeaderSize = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+constexpr uint32_t kBlockRecord = 1;
+constexpr uint32_t kTombstoneRecord = 2;
+/* size of a record which is still being written, never fits into a file */
+constexpr uint64_t kIncompleteRecordSize = UINT64_MAX;
+constexpr size_t kAppendBatchSize = 64 * 1024 * 1024; /* 64 MB */
+
+[[noreturn]] static void indexError(const char* message, const std::string& detail) {
+    fprintf(stderr, "[sword::Index] error: %s %s!\n", message, detail.c_str());
+    exit(1);
+}
+
+static bool readBytes(FILE* file, void* dst, size_t size) {
+    return fread(dst, 1, size, file) == size;
+}
+
+static void writeBytes(FILE* file, const void* src, size_t size,
+    const std::string& path) {
+
+    if (fwrite(src, 1, size, file) != size) {
+        indexError("unable to write to", path);
+    }
+}
+
+static bool readString(FILE* file, std::string& dst) {
+
+    uint32_t length = 0;
+    if (!readBytes(file, &length, sizeof(length))) {
+        return false;
+    }
+    dst.resize(length);
+    return length == 0 || readBytes(file, &dst[0], length);
+}
+
+static void writeString(FILE* file, const std::string& src, const std::string& path) {
+
+    uint32_t length = src.size();
+    writeBytes(file, &length, sizeof(length), path);
+    writeBytes(file, src.data(), length, path);
+}
+
+static void writeRecordHeader(FILE* file, uint32_t type, uint32_t version,
+    uint64_t size, const std::string& path) {
+
+    writeBytes(file, &type, sizeof(type), path);
+    writeBytes(file, &version, sizeof(version), path);
+    writeBytes(file, &size, sizeof(size), path);
+}
+
+static std::string chainId(const std::string& name) {
+    return name.substr(0, name.find_first_of(" \t"));
+}
+
+static bool isRemoved(const std::unordered_map<std::string, uint32_t>& tombstones,
+    const std::string& name, uint32_t block_version) {
+
+    if (tombstones.empty()) {
+        return false;
+    }
+    auto it = tombstones.find(chainId(name));
+    return it != tombstones.end() && it->second > block_version;
+}
+
+/* ************************************************************************** */
+/* IndexScanner - chains of blocks appended after version since */
+
+class IndexScanner {
+public:
+
+    IndexScanner(const std::string& path, uint64_t size, uint32_t since)
+            : path_(path), file_(fopen(path.c_str(), "rb")), size_(size),
+            offset_(kHeaderSize), since_(since), version_(0), num_chains_(0) {
+
+        if (file_ == nullptr) {
+            indexError("unable to open file", path);
+        }
+    }
+
+    ~IndexScanner() {
+        fclose(file_);
+    }
+
+    bool next(uint32_t& version, std::string& name, std::string& data) {
+
+        while (num_chains_ == 0) {
+
+            if (offset_ >= size_) {
+                return false;
+            }
+
+            uint32_t type = 0;
+            uint64_t size = 0;
+            if (fseeko(file_, offset_, SEEK_SET) != 0 ||
+                !readBytes(file_, &type, sizeof(type)) ||
+                !readBytes(file_, &version_, sizeof(version_)) ||
+                !readBytes(file_, &size, sizeof(size))) {
+                indexError("unable to read", path_);
+            }
+            offset_ += kRecordHeaderSize + size;
+
+            if (type == kBlockRecord && version_ > since_) {
+                uint64_t num_residues = 0;
+                if (!readBytes(file_, &num_chains_, sizeof(num_chains_)) ||
+                    !readBytes(file_, &num_residues, sizeof(num_residues))) {
+                    indexError("unable to read", path_);
+                }
+            }
+        }
+
+        if (!readString(file_, name) || !readString(file_, data)) {
+            indexError("unable to read", path_);
+        }
+        --num_chains_;
+        version = version_;
+
+        return true;
+    }
+
+private:
+
+    IndexScanner(const IndexScanner&) = delete;
+    const IndexScanner& operator=(const IndexScanner&) = delete;
+
+    std::string path_;
+    FILE* file_;
+    uint64_t size_;
+    uint64_t offset_;
+    uint32_t since_;
+    uint32_t version_;
+    uint32_t num_chains_;
+};
+
+/* ************************************************************************** */
+/* IndexStream - FASTA text of chains which were not removed */
+
+class IndexStream: public InputStream {
+public:
+
+    IndexStream(const std::string& path, uint64_t size, uint32_t since,
+        const std::unordered_map<std::string, uint32_t>& tombstones)
+            : InputStream(), scanner_(path, size, since), tombstones_(tombstones),
+            buffer_(), buffer_begin_(0), name_(), data_() {
+    }
+
+    ~IndexStream() = default;
+
+    size_t read(char* dst, size_t size) override {
+
+        uint32_t version = 0;
+
+        while (buffer_begin_ == buffer_.size()) {
+
+            buffer_.clear();
+            buffer_begin_ = 0;
+
+            if (!scanner_.next(version, name_, data_)) {
+                return 0;
+            }
+            if (isRemoved(tombstones_, name_, version)) {
+                continue;
+            }
+
+            buffer_ += '>';
+            buffer_ += name_;
+            buffer_ += '\n';
+            buffer_ += data_;
+            buffer_ += '\n';
+        }
+
+        size_t length = std::min(size, buffer_.size() - buffer_begin_);
+        memcpy(dst, buffer_.data() + buffer_begin_, length);
+        buffer_begin_ += length;
+
+        return length;
+    }
+
+    CompressionType compression() const override {
+        return CompressionType::kNone;
+    }
+
+private:
+
+    IndexScanner scanner_;
+    std::unordered_map<std::string, uint32_t> tombstones_;
+
+    std::string buffer_;
+    size_t buffer_begin_;
+    std::string name_;
+    std::string data_;
+};
+
+/* ************************************************************************** */
+
+std::unique_ptr<Index> createIndex(const std::string& path) {
+    return std::unique_ptr<Index>(new Index(path));
+}
+
+bool parseIndexPath(const std::string& path, std::string& index_path,
+    uint32_t& since) {
+
+    index_path = path;
+    since = 0;
+
+    struct stat path_stat;
+    if (stat(path.c_str(), &path_stat) != 0) {
+        auto at = path.rfind('@');
+        if (at == std::string::npos || at == 0 || at + 1 == path.size() ||
+            path.find_first_not_of("0123456789", at + 1) != std::string::npos) {
+            return false;
+        }
+        index_path = path.substr(0, at);
+        since = strtoul(path.c_str() + at + 1, nullptr, 10);
+
+        if (stat(index_path.c_str(), &path_stat) != 0) {
+            return false;
+        }
+    }
+    if (!S_ISREG(path_stat.st_mode)) {
+        return false;
+    }
+
+    auto file = fopen(index_path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char magic[sizeof(kIndexMagic)];
+    bool is_index = readBytes(file, magic, sizeof(magic)) &&
+        memcmp(magic, kIndexMagic, sizeof(magic)) == 0;
+    fclose(file);
+
+    return is_index;
+}
+
+uint64_t databaseCells(const std::string& path, uint64_t cells) {
+
+    /* evalues of a search restricted to newer blocks of an index are
+     * computed against the whole index */
+    std::string index_path;
+    uint32_t since = 0;
+    if (parseIndexPath(path, index_path, since)) {
+        return createIndex(index_path)->cells();
+    }
+    return cells;
+}
+
+Index::Index(const std::string& path)
+        : path_(path), version_(0), size_(kHeaderSize), blocks_(),
+        tombstones_() {
+
+    auto file = fopen(path.c_str(), "rb");
+
+    if (file == nullptr) {
+        if (errno != ENOENT) {
+            indexError("unable to open file", path);
+        }
+        file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            indexError("unable to create file", path);
+        }
+        writeBytes(file, kIndexMagic, sizeof(kIndexMagic), path);
+        writeBytes(file, &kIndexFormat, sizeof(kIndexFormat), path);
+        if (fclose(file) != 0) {
+            indexError("unable to write to", path);
+        }
+        return;
+    }
+
+    char magic[sizeof(kIndexMagic)];
+    uint32_t format = 0;
+    if (!readBytes(file, magic, sizeof(magic)) ||
+        memcmp(magic, kIndexMagic, sizeof(magic)) != 0 ||
+        !readBytes(file, &format, sizeof(format))) {
+        indexError("not a sword index", path);
+    }
+    if (format != kIndexFormat) {
+        indexError("unsupported format of index", path);
+    }
+
+    fseeko(file, 0, SEEK_END);
+    uint64_t file_size = ftello(file);
+
+    while (size_ + kRecordHeaderSize <= file_size) {
+
+        uint32_t type = 0, version = 0;
+        uint64_t size = 0;
+
+        fseeko(file, size_, SEEK_SET);
+        if (!readBytes(file, &type, sizeof(type)) ||
+            !readBytes(file, &version, sizeof(version)) ||
+            !readBytes(file, &size, sizeof(size)) ||
+            size > file_size - size_ - kRecordHeaderSize) {
+            break;
+        }
+
+        if (type == kBlockRecord) {
+
+            IndexBlock block = {version, 0, 0, 0, 0};
+            if (size < sizeof(block.num_chains) + sizeof(block.num_residues) ||
+                !readBytes(file, &block.num_chains, sizeof(block.num_chains)) ||
+                !readBytes(file, &block.num_residues, sizeof(block.num_residues))) {
+                break;
+            }
+            blocks_.emplace_back(block);
+
+        } else if (type == kTombstoneRecord) {
+
+            uint32_t num_ids = 0;
+            if (!readBytes(file, &num_ids, sizeof(num_ids))) {
+                break;
+            }
+            std::string id;
+            for (uint32_t i = 0; i < num_ids; ++i) {
+                if (!readString(file, id)) {
+                    indexError("unable to read", path);
+                }
+                auto& it = tombstones_[id];
+                it = std::max(it, version);
+            }
+
+            uint32_t num_blocks = 0;
+            if (!readBytes(file, &num_blocks, sizeof(num_blocks))) {
+                indexError("unable to read", path);
+            }
+            for (uint32_t i = 0; i < num_blocks; ++i) {
+                IndexBlock removed = {0, 0, 0, 0, 0};
+                if (!readBytes(file, &removed.version, sizeof(removed.version)) ||
+                    !readBytes(file, &removed.num_chains, sizeof(removed.num_chains)) ||
+                    !readBytes(file, &removed.num_residues, sizeof(removed.num_residues))) {
+                    indexError("unable to read", path);
+                }
+                auto block = std::lower_bound(blocks_.begin(), blocks_.end(),
+                    removed.version, [](const IndexBlock& lhs, uint32_t rhs) -> bool {
+                        return lhs.version < rhs;
+                    });
+                if (block == blocks_.end() || block->version != removed.version) {
+                    indexError("tombstone of an unknown block in", path);
+                }
+                block->num_removed_chains += removed.num_chains;
+                block->num_removed_residues += removed.num_residues;
+            }
+
+            if (static_cast<uint64_t>(ftello(file)) > size_ + kRecordHeaderSize + size) {
+                indexError("corrupted tombstone in", path);
+            }
+
+        } else {
+            indexError("unknown record in", path);
+        }
+
+        version_ = std::max(version_, version);
+        size_ += kRecordHeaderSize + size;
+    }
+
+    fclose(file);
+
+    if (size_ != file_size) {
+        fprintf(stderr, "[sword::Index] warning: ignoring an interrupted update "
+            "at the end of %s\n", path.c_str());
+    }
+}
+
+uint64_t Index::cells() const {
+
+    uint64_t cells = 0;
+    for (const auto& it: blocks_) {
+        cells += it.num_residues - it.num_removed_residues;
+    }
+    return cells;
+}
+
+uint32_t Index::append(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto reader = createReader(path, thread_pool);
+
+    auto file = fopen(path_.c_str(), "r+b");
+    if (file == nullptr || fseeko(file, size_, SEEK_SET) != 0) {
+        indexError("unable to open file", path_);
+    }
+
+    /* the header is rewritten once the block is complete, until then the
+     * record is ignored by createIndex */
+    IndexBlock block = {version_ + 1, 0, 0, 0, 0};
+    writeRecordHeader(file, kBlockRecord, block.version, kIncompleteRecordSize,
+        path_);
+    writeBytes(file, &block.num_chains, sizeof(block.num_chains), path_);
+    writeBytes(file, &block.num_residues, sizeof(block.num_residues), path_);
+
+    uint64_t size = sizeof(block.num_chains) + sizeof(block.num_residues);
+    std::string data;
+
+    bool status = true;
+    while (status) {
+
+        ChainSet chains;
+        status = reader->read_chains(chains, kAppendBatchSize);
+
+        for (const auto& it: chains) {
+            data.resize(it->length());
+            for (uint32_t i = 0; i < it->length(); ++i) {
+                data[i] = it->data()[i] + 'A';
+            }
+            writeString(file, it->name(), path_);
+            writeString(file, data, path_);
+
+            size += 2 * sizeof(uint32_t) + it->name_length() + it->length();
+            ++block.num_chains;
+            block.num_residues += it->length();
+        }
+    }
+
+    if (block.num_chains == 0 || !reader->error().empty()) {
+        fflush(file);
+        if (ftruncate(fileno(file), size_) != 0) {
+            fclose(file);
+            indexError("unable to write to", path_);
+        }
+        fclose(file);
+        if (!reader->error().empty()) {
+            indexError("unable to read", path + ", " + reader->error());
+        }
+        indexError("no chains found in", path);
+    }
+
+    fseeko(file, size_, SEEK_SET);
+    writeRecordHeader(file, kBlockRecord, block.version, size, path_);
+    writeBytes(file, &block.num_chains, sizeof(block.num_chains), path_);
+    writeBytes(file, &block.num_residues, sizeof(block.num_residues), path_);
+
+    size_ += kRecordHeaderSize + size;
+
+    if (fflush(file) != 0 || ftruncate(fileno(file), size_) != 0 ||
+        fclose(file) != 0) {
+        indexError("unable to write to", path_);
+    }
+
+    blocks_.emplace_back(block);
+    version_ = block.version;
+
+    return version_;
+}
+
+uint32_t Index::remove(const std::vector<std::string>& ids) {
+
+    std::unordered_set<std::string> pending(ids.begin(), ids.end());
+    std::unordered_set<std::string> found;
+    std::map<uint32_t, IndexBlock> removed;
+
+    {
+        IndexScanner scanner(path_, size_, 0);
+        uint32_t version = 0;
+        std::string name, data;
+
+        while (scanner.next(version, name, data)) {
+            auto id = chainId(name);
+            if (pending.count(id) == 0 || isRemoved(tombstones_, name, version)) {
+                continue;
+            }
+            found.insert(id);
+
+            auto& it = removed[version];
+            it.version = version;
+            ++it.num_chains;
+            it.num_residues += data.size();
+        }
+    }
+
+    if (found.empty()) {
+        return 0;
+    }
+
+    auto file = fopen(path_.c_str(), "r+b");
+    if (file == nullptr || fseeko(file, size_, SEEK_SET) != 0) {
+        indexError("unable to open file", path_);
+    }
+
+    uint32_t version = version_ + 1;
+    uint32_t num_ids = found.size();
+    uint32_t num_blocks = removed.size();
+
+    uint64_t size = 2 * sizeof(uint32_t) + num_blocks * (2 * sizeof(uint32_t) +
+        sizeof(uint64_t));
+    for (const auto& it: found) {
+        size += sizeof(uint32_t) + it.size();
+    }
+
+    writeRecordHeader(file, kTombstoneRecord, version, size, path_);
+    writeBytes(file, &num_ids, sizeof(num_ids), path_);
+    for (const auto& it: found) {
+        writeString(file, it, path_);
+        tombstones_[it] = version;
+    }
+
+    uint32_t num_chains = 0;
+
+    writeBytes(file, &num_blocks, sizeof(num_blocks), path_);
+    for (const auto& it: removed) {
+        writeBytes(file, &it.second.version, sizeof(it.second.version), path_);
+        writeBytes(file, &it.second.num_chains, sizeof(it.second.num_chains), path_);
+        writeBytes(file, &it.second.num_residues, sizeof(it.second.num_residues), path_);
+
+        auto block = std::lower_bound(blocks_.begin(), blocks_.end(), it.first,
+            [](const IndexBlock& lhs, uint32_t rhs) -> bool {
+                return lhs.version < rhs;
+            });
+        block->num_removed_chains += it.second.num_chains;
+        block->num_removed_residues += it.second.num_residues;
+
+        num_chains += it.second.num_chains;
+    }
+
+    size_ += kRecordHeaderSize + size;
+
+    if (fflush(file) != 0 || ftruncate(fileno(file), size_) != 0 ||
+        fclose(file) != 0) {
+        indexError("unable to write to", path_);
+    }
+
+    version_ = version;
+
+    return num_chains;
+}
+
+std::unique_ptr<InputStream> Index::stream(uint32_t since) const {
+    return std::unique_ptr<InputStream>(new IndexStream(path_, size_, since,
+        tombstones_));
+}
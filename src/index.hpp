@@ -0,0 +1,115 @@
+/*!
+ * @file index.hpp
+ *
+ * @brief Index class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+namespace thread_pool {
+    class ThreadPool;
+}
+
+class InputStream;
+class Index;
+
+/*!
+ * @brief Opens the database index at path, an empty index is created if path
+ * does not exist
+ * @details An index is an append-only file of records, each stamped with the
+ * version it was written in: blocks of chains added together and tombstones
+ * which remove chains by id (the first word of the name) from all earlier
+ * blocks. A record cut short by an interrupted update is ignored and
+ * overwritten by the next one.
+ */
+std::unique_ptr<Index> createIndex(const std::string& path);
+
+/*!
+ * @brief Returns true if path is an index, optionally followed by @<version>
+ * to select only blocks appended after that version; index_path and since are
+ * set accordingly (since is 0 without a version)
+ */
+bool parseIndexPath(const std::string& path, std::string& index_path,
+    uint32_t& since);
+
+/*!
+ * @brief Number of residues evalues are computed against for the database at
+ * path which has cells residues: all residues of the index if path selects
+ * blocks of an index, cells otherwise
+ */
+uint64_t databaseCells(const std::string& path, uint64_t cells);
+
+struct IndexBlock {
+    uint32_t version;
+    uint32_t num_chains;
+    uint64_t num_residues;
+    /* chains removed from the block by later tombstones */
+    uint32_t num_removed_chains;
+    uint64_t num_removed_residues;
+};
+
+class Index {
+public:
+
+    ~Index() = default;
+
+    /*!
+     * @brief Version of the last update (0 for an empty index)
+     */
+    uint32_t version() const {
+        return version_;
+    }
+
+    const std::vector<IndexBlock>& blocks() const {
+        return blocks_;
+    }
+
+    /*!
+     * @brief Number of residues of all chains which were not removed, needed
+     * for EValue (also when only newer blocks are searched, so that evalues
+     * stay comparable between searches)
+     */
+    uint64_t cells() const;
+
+    /*!
+     * @brief Appends chains of a FASTA file (or another index) as a new block
+     * and returns its version
+     */
+    uint32_t append(const std::string& path,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+    /*!
+     * @brief Removes chains with the given ids from all blocks with a
+     * tombstone, returns the number of removed chains (no tombstone is
+     * written if there are none)
+     */
+    uint32_t remove(const std::vector<std::string>& ids);
+
+    /*!
+     * @brief Chains which were not removed in FASTA format, only blocks
+     * appended after version since are included
+     */
+    std::unique_ptr<InputStream> stream(uint32_t since = 0) const;
+
+    friend std::unique_ptr<Index> createIndex(const std::string& path);
+
+private:
+
+    Index(const std::string& path);
+    Index(const Index&) = delete;
+    const Index& operator=(const Index&) = delete;
+
+    std::string path_;
+    uint32_t version_;
+    /* size of the file without an interrupted trailing record */
+    uint64_t size_;
+    std::vector<IndexBlock> blocks_;
+    /* version of the newest tombstone of each removed id */
+    std::unordered_map<std::string, uint32_t> tombstones_;
+};
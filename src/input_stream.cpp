@@ -0,0 +1,515 @@
+/*!
+ * @file input_stream.cpp
+ *
+ * @brief InputStream class source file
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <future>
+#include <algorithm>
+
+#include "thread_pool/thread_pool.hpp"
+
+#ifdef SWORD_USE_ZLIB
+#include "zlib.h"
+#endif
+
+#ifdef SWORD_USE_ZSTD
+#include "zstd.h"
+#endif
+
+#include "input_stream.hpp"
+
+constexpr uint32_t kMagicLength = 4;
+constexpr size_t kGzipChunkSize = 1024 * 1024; /* 1 MB */
+constexpr size_t kZstdChunkSize = 16 * 1024 * 1024; /* 16 MB per thread */
+constexpr size_t kZstdMaxFrameSize = 256 * 1024 * 1024; /* 256 MB */
+
+[[noreturn]] static void inputError(const char* message, const std::string& detail) {
+    fprintf(stderr, "[sword::InputStream] error: %s %s!\n", message, detail.c_str());
+    exit(1);
+}
+
+/* ************************************************************************** */
+/* FileStream - raw bytes of a file (or pipe) */
+
+class FileStream: public InputStream {
+public:
+
+    FileStream(int file_descriptor)
+            : InputStream(), file_descriptor_(file_descriptor), pending_() {
+    }
+
+    ~FileStream() {
+        if (file_descriptor_ >= 0) {
+            close(file_descriptor_);
+        }
+    }
+
+    size_t read(char* dst, size_t size) override {
+
+        if (!error().empty()) {
+            return 0;
+        }
+
+        if (!pending_.empty()) {
+            size_t length = std::min(size, pending_.size());
+            memcpy(dst, pending_.data(), length);
+            pending_.erase(0, length);
+            return length;
+        }
+
+        while (true) {
+            auto length = ::read(file_descriptor_, dst, size);
+            if (length >= 0) {
+                return length;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* a receive timeout set on a socket expired */
+                return fail("timed out while reading input");
+            }
+            if (errno != EINTR) {
+                return fail(std::string("unable to read input, ") + strerror(errno));
+            }
+        }
+    }
+
+    /* reads until size bytes are read or the input ends */
+    size_t read_full(char* dst, size_t size) {
+
+        size_t total_length = 0;
+        while (total_length < size) {
+            auto length = read(dst + total_length, size - total_length);
+            if (length == 0) {
+                break;
+            }
+            total_length += length;
+        }
+        return total_length;
+    }
+
+    /* pushes bytes back so that they are returned first by the next read */
+    void unread(const char* src, size_t size) {
+        pending_.insert(0, src, size);
+    }
+
+    /* ends the input, e.g. if it can not be decompressed */
+    void discard(const std::string& message) {
+        fail(message);
+    }
+
+    CompressionType compression() const override {
+        return CompressionType::kNone;
+    }
+
+private:
+
+    int file_descriptor_;
+    std::string pending_;
+};
+
+/* ************************************************************************** */
+/* GzipStream - streaming inflate, concatenated members are supported */
+
+#ifdef SWORD_USE_ZLIB
+
+class GzipStream: public InputStream {
+public:
+
+    GzipStream(std::unique_ptr<FileStream> source)
+            : InputStream(), source_(std::move(source)), input_(kGzipChunkSize),
+            stream_(), is_member_open_(false), is_end_(false) {
+
+        /* 15 + 32 enables automatic detection of gzip and zlib headers */
+        if (inflateInit2(&stream_, 15 + 32) != Z_OK) {
+            inputError("unable to initialize", "zlib");
+        }
+    }
+
+    ~GzipStream() {
+        inflateEnd(&stream_);
+    }
+
+    size_t read(char* dst, size_t size) override {
+
+        if (!error().empty()) {
+            return 0;
+        }
+
+        stream_.next_out = reinterpret_cast<Bytef*>(dst);
+        stream_.avail_out = size;
+
+        while (stream_.avail_out == size) {
+
+            if (stream_.avail_in == 0) {
+                if (is_end_) {
+                    break;
+                }
+                auto length = source_->read(input_.data(), input_.size());
+                if (length == 0) {
+                    is_end_ = true;
+                    if (!source_->error().empty()) {
+                        return fail(source_->error());
+                    }
+                    if (is_member_open_) {
+                        return fail("truncated gzip input");
+                    }
+                    break;
+                }
+                stream_.next_in = reinterpret_cast<Bytef*>(input_.data());
+                stream_.avail_in = length;
+            }
+
+            is_member_open_ = true;
+            auto status = inflate(&stream_, Z_NO_FLUSH);
+
+            if (status == Z_STREAM_END) {
+                /* multi-member files (pigz, bgzip, cat a.gz b.gz) */
+                is_member_open_ = false;
+                inflateReset(&stream_);
+            } else if (status != Z_OK && status != Z_BUF_ERROR) {
+                return fail(std::string("corrupted gzip input, ") +
+                    (stream_.msg ? stream_.msg : ""));
+            }
+        }
+
+        return size - stream_.avail_out;
+    }
+
+    CompressionType compression() const override {
+        return CompressionType::kGzip;
+    }
+
+private:
+
+    std::unique_ptr<FileStream> source_;
+    std::vector<char> input_;
+    z_stream stream_;
+    bool is_member_open_;
+    bool is_end_;
+};
+
+#endif
+
+/* ************************************************************************** */
+/* ZstdStream - frames with known content sizes are decompressed in parallel,
+ * large frames or frames without a content size fall back to streaming */
+
+#ifdef SWORD_USE_ZSTD
+
+/* returns an error message, nullptr if the frame was decompressed */
+static const char* decompressZstdFrame(char* dst, size_t dst_size,
+    const char* src, size_t src_size) {
+
+    std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(),
+        ZSTD_freeDCtx);
+
+    auto length = ZSTD_decompressDCtx(context.get(), dst, dst_size, src, src_size);
+    if (ZSTD_isError(length)) {
+        return ZSTD_getErrorName(length);
+    }
+    if (length != dst_size) {
+        return "frame content size mismatch";
+    }
+    return nullptr;
+}
+
+class ZstdStream: public InputStream {
+public:
+
+    ZstdStream(std::unique_ptr<FileStream> source,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool)
+            : InputStream(), source_(std::move(source)), thread_pool_(thread_pool),
+            input_(), input_begin_(0), input_end_(0), output_(), output_begin_(0),
+            output_end_(0), stream_(ZSTD_createDStream(), ZSTD_freeDStream),
+            is_streaming_(false), is_end_(false) {
+
+        size_t num_threads = thread_pool_ ? thread_pool_->num_threads() : 1;
+        input_.resize(kZstdChunkSize * std::max(num_threads, (size_t) 1));
+    }
+
+    ~ZstdStream() = default;
+
+    size_t read(char* dst, size_t size) override {
+
+        if (!error().empty()) {
+            return 0;
+        }
+
+        while (output_begin_ == output_end_) {
+            if (!decompress()) {
+                return 0;
+            }
+        }
+
+        size_t length = std::min(size, output_end_ - output_begin_);
+        memcpy(dst, output_.data() + output_begin_, length);
+        output_begin_ += length;
+
+        return length;
+    }
+
+    CompressionType compression() const override {
+        return CompressionType::kZstd;
+    }
+
+private:
+
+    struct Frame {
+        size_t begin;
+        size_t size;
+        size_t output_begin;
+        size_t output_size;
+    };
+
+    /* moves unused input to the front and reads until the buffer is full, the
+     * input ends or a pipe has no more data at the moment */
+    bool fill_input() {
+
+        if (input_begin_ > 0) {
+            memmove(input_.data(), input_.data() + input_begin_,
+                input_end_ - input_begin_);
+            input_end_ -= input_begin_;
+            input_begin_ = 0;
+        }
+
+        bool status = false;
+        while (!is_end_ && input_end_ < input_.size()) {
+            size_t requested = input_.size() - input_end_;
+            auto length = source_->read(input_.data() + input_end_, requested);
+            if (length == 0) {
+                is_end_ = true;
+                if (!source_->error().empty()) {
+                    fail(source_->error());
+                }
+                break;
+            }
+            input_end_ += length;
+            status = true;
+            if (length < requested) {
+                break;
+            }
+        }
+
+        return status;
+    }
+
+    bool decompress() {
+
+        output_begin_ = output_end_ = 0;
+
+        if (is_streaming_) {
+            return decompress_stream();
+        }
+
+        if (input_end_ - input_begin_ < input_.size() / 2) {
+            fill_input();
+        }
+        if (input_begin_ == input_end_ || !error().empty()) {
+            return false;
+        }
+
+        size_t num_threads = thread_pool_ ? thread_pool_->num_threads() : 1;
+        size_t max_frames = 4 * num_threads;
+
+        std::vector<Frame> frames;
+        size_t output_size = 0;
+
+        for (auto i = input_begin_; i < input_end_ && frames.size() < max_frames;) {
+
+            auto size = ZSTD_findFrameCompressedSize(input_.data() + i, input_end_ - i);
+            if (ZSTD_isError(size)) {
+                break; /* incomplete or invalid */
+            }
+
+            auto content_size = ZSTD_getFrameContentSize(input_.data() + i,
+                input_end_ - i);
+            if (content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+                content_size == ZSTD_CONTENTSIZE_ERROR ||
+                content_size > kZstdMaxFrameSize) {
+                break;
+            }
+
+            frames.push_back({ i, size, output_size, content_size });
+            output_size += content_size;
+            i += size;
+        }
+
+        if (frames.empty()) {
+            auto status = ZSTD_initDStream(stream_.get());
+            if (ZSTD_isError(status)) {
+                inputError("unable to initialize zstd,", ZSTD_getErrorName(status));
+            }
+            is_streaming_ = true;
+            return decompress_stream();
+        }
+
+        if (output_.size() < output_size) {
+            output_.resize(output_size);
+        }
+
+        const char* frame_error = nullptr;
+
+        if (thread_pool_ && frames.size() > 1) {
+            std::vector<std::future<const char*>> thread_futures;
+            for (const auto& it: frames) {
+                thread_futures.emplace_back(thread_pool_->submit(decompressZstdFrame,
+                    output_.data() + it.output_begin, it.output_size,
+                    input_.data() + it.begin, it.size));
+            }
+            for (auto& it: thread_futures) {
+                auto status = it.get();
+                if (status != nullptr) {
+                    frame_error = status;
+                }
+            }
+        } else {
+            for (const auto& it: frames) {
+                frame_error = decompressZstdFrame(output_.data() + it.output_begin,
+                    it.output_size, input_.data() + it.begin, it.size);
+                if (frame_error != nullptr) {
+                    break;
+                }
+            }
+        }
+
+        if (frame_error != nullptr) {
+            fail(std::string("corrupted zstd input, ") + frame_error);
+            return false;
+        }
+
+        input_begin_ = frames.back().begin + frames.back().size;
+        output_end_ = output_size;
+
+        return true;
+    }
+
+    bool decompress_stream() {
+
+        if (output_.size() < ZSTD_DStreamOutSize()) {
+            output_.resize(ZSTD_DStreamOutSize());
+        }
+
+        ZSTD_outBuffer output = { output_.data(), output_.size(), 0 };
+
+        while (output.pos == 0) {
+
+            if (input_begin_ == input_end_ && !fill_input()) {
+                if (error().empty()) {
+                    fail("truncated zstd input");
+                }
+                return false;
+            }
+
+            ZSTD_inBuffer input = { input_.data() + input_begin_,
+                input_end_ - input_begin_, 0 };
+
+            auto status = ZSTD_decompressStream(stream_.get(), &output, &input);
+            if (ZSTD_isError(status)) {
+                fail(std::string("corrupted zstd input, ") +
+                    ZSTD_getErrorName(status));
+                return false;
+            }
+
+            input_begin_ += input.pos;
+
+            if (status == 0) {
+                is_streaming_ = false; /* frame done */
+                break;
+            }
+        }
+
+        output_end_ = output.pos;
+
+        return true;
+    }
+
+    std::unique_ptr<FileStream> source_;
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool_;
+
+    std::vector<char> input_;
+    size_t input_begin_;
+    size_t input_end_;
+
+    std::vector<char> output_;
+    size_t output_begin_;
+    size_t output_end_;
+
+    std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream*)> stream_;
+    bool is_streaming_;
+    bool is_end_;
+};
+
+#endif
+
+/* ************************************************************************** */
+
+static CompressionType detectCompression(const unsigned char* magic, size_t length) {
+
+    if (length >= 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+        return CompressionType::kGzip;
+    }
+    if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F &&
+        magic[3] == 0xFD) {
+        return CompressionType::kZstd;
+    }
+    /* zstd skippable frame, written in front of every frame by pzstd */
+    if (length >= 4 && (magic[0] & 0xF0) == 0x50 && magic[1] == 0x2A &&
+        magic[2] == 0x4D && magic[3] == 0x18) {
+        return CompressionType::kZstd;
+    }
+
+    return CompressionType::kNone;
+}
+
+std::unique_ptr<InputStream> createInputStream(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto file_descriptor = path == "-" ? dup(STDIN_FILENO) : open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        std::unique_ptr<FileStream> source(new FileStream(file_descriptor));
+        source->discard("unable to open file " + path);
+        return std::unique_ptr<InputStream>(source.release());
+    }
+
+    return createInputStream(file_descriptor, thread_pool);
+}
+
+std::unique_ptr<InputStream> createInputStream(int file_descriptor,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    std::unique_ptr<FileStream> source(new FileStream(file_descriptor));
+    (void) thread_pool;
+
+    char magic[kMagicLength];
+    auto magic_length = source->read_full(magic, kMagicLength);
+    source->unread(magic, magic_length);
+
+    switch (detectCompression(reinterpret_cast<unsigned char*>(magic), magic_length)) {
+        case CompressionType::kGzip:
+#ifdef SWORD_USE_ZLIB
+            return std::unique_ptr<InputStream>(new GzipStream(std::move(source)));
+#else
+            source->discard("sword was built without zlib, unable to read gzip input");
+            break;
+#endif
+        case CompressionType::kZstd:
+#ifdef SWORD_USE_ZSTD
+            return std::unique_ptr<InputStream>(new ZstdStream(std::move(source),
+                thread_pool));
+#else
+            source->discard("sword was built without zstd, unable to read zstd input");
+            break;
+#endif
+        case CompressionType::kNone:
+        default:
+            break;
+    }
+
+    return std::unique_ptr<InputStream>(source.release());
+}
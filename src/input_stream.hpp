@@ -0,0 +1,85 @@
+/*!
+ * @file input_stream.hpp
+ *
+ * @brief InputStream class header file
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+namespace thread_pool {
+    class ThreadPool;
+}
+
+class InputStream;
+
+enum class CompressionType {
+    kNone,
+    kGzip, // gzip or zlib (possibly multi-member)
+    kZstd // zstd (possibly multi-frame)
+};
+
+/*!
+ * @brief Opens path ("-" for stdin) and detects its compression from the
+ * leading magic bytes
+ * @details Frames of multi-frame zstd files (e.g. created with pzstd) are
+ * decompressed in parallel if a thread pool is given. A path which can not be
+ * opened gives a stream which reads nothing and reports it with error().
+ */
+std::unique_ptr<InputStream> createInputStream(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+/*!
+ * @brief Same as above for an open file descriptor (e.g. a socket), which is
+ * closed with the stream
+ */
+std::unique_ptr<InputStream> createInputStream(int file_descriptor,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+class InputStream {
+public:
+
+    virtual ~InputStream() = default;
+
+    /*!
+     * @brief Reads at most size (decompressed) bytes into dst
+     * @details Returns as soon as some data is available, therefore the
+     * number of bytes read can be smaller than size. Returns 0 at the end of
+     * input, which is also where input that can not be read ends (see
+     * error).
+     */
+    virtual size_t read(char* dst, size_t size) = 0;
+
+    virtual CompressionType compression() const = 0;
+
+    /*!
+     * @brief Description of the problem which ended the input (failed read,
+     * corrupted or truncated compressed data), empty if it ended normally
+     */
+    const std::string& error() const {
+        return error_;
+    }
+
+protected:
+
+    InputStream() = default;
+
+    /* ends the input with message, returns 0 for read */
+    size_t fail(const std::string& message) {
+        if (error_.empty()) {
+            error_ = message;
+        }
+        return 0;
+    }
+
+private:
+
+    InputStream(const InputStream&) = delete;
+    const InputStream& operator=(const InputStream&) = delete;
+
+    std::string error_;
+};
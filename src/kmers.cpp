@@ -4,161 +4,474 @@
  * @brief Kmers class source file
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <algorithm>
+
+#include "thread_pool/thread_pool.hpp"
 
 #include "chain.hpp"
 #include "score_matrix.hpp"
 #include "kmers.hpp"
 
-constexpr uint32_t kProtMaxValue = 25;
 constexpr uint32_t kProtBitLength = 5;
-
-std::vector<uint32_t> kDelMask = { 0, 0, 0, 0x7FFF, 0xFFFFF, 0x1FFFFFF };
+constexpr uint32_t kReducedBitLength = 4;
 
 std::vector<char> kAminoAcids = {
     /* A, C, D, E, F, G, H, I, K, L, M, N, P, Q, R, S, T, V, W, Y */
     0, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 15, 16, 17, 18, 19, 21, 22, 24
 };
 
-static size_t numKmers(size_t kmer_length) {
+/* B, Z, J, U and O are put into the class of D, E, L, C and K respectively,
+ * X (and other codes) form a class of their own */
+std::vector<char> kMurphy10Map = {
+    /* A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P, Q, R, S, T, U, V, W, X */
+    2, 7, 1, 7, 7, 6, 3, 9, 0, 0, 8, 0, 0, 7, 8, 5, 7, 8, 4, 4, 1, 0, 6, 10,
+    /* Y, Z */
+    6, 7
+};
+
+std::vector<char> kSeB14Map = {
+    /* A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P, Q, R, S, T, U, V, W, X */
+    0, 2, 1, 2, 3, 4, 5, 6, 7, 9, 8, 9, 9, 10, 8, 11, 3, 8, 12, 12, 1, 7, 13, 14,
+    /* Y, Z */
+    4, 3
+};
+
+[[noreturn]] static void kmersError(const std::string& message) {
+    fprintf(stderr, "[sword::Kmers] error: %s!\n", message.c_str());
+    exit(1);
+}
+
+static size_t numKmers(size_t kmer_length, uint32_t max_value, uint32_t bits) {
 
     size_t num_kmers = 0;
 
     for (size_t i = 0; i < kmer_length; ++i) {
-        num_kmers += kProtMaxValue << (i * kProtBitLength);
+        num_kmers += static_cast<size_t>(max_value) << (i * bits);
     }
 
     return num_kmers + 1;
 }
 
-static void createKmersRecursive(std::vector<std::string>& kmers,
-    std::string& current_kmer, uint32_t level) {
+/* kmers are given as positions in kAminoAcids, rows[i] contains scores of
+ * kAminoAcids[i] against all amino acids (paired with their positions) in
+ * descending order and bounds[i] is the highest score of kmer[i:] against any
+ * kmer; all neighbours scoring at least full_score are kept, together with the
+ * first num_ties of those scoring less (and at least score_threshold) */
+struct NeighbourhoodSearch {
+    const std::vector<std::vector<std::pair<int, uint32_t>>>& rows;
+    const uint32_t* kmer;
+    const int* bounds;
+    uint32_t code;
+    uint32_t kmer_length;
+    uint32_t bits;
+    int score_threshold;
+    int full_score;
+    uint32_t num_ties;
+};
+
+static void addNeighbour(std::vector<uint32_t>& dst, NeighbourhoodSearch& search,
+    int score, uint32_t code) {
 
-    if (level == 0) {
-        kmers.emplace_back(current_kmer);
+    if (code == search.code) {
         return;
     }
-
-    for (const auto& aa: kAminoAcids) {
-        current_kmer.push_back(aa);
-        createKmersRecursive(kmers, current_kmer, level - 1);
-        current_kmer.pop_back();
+    if (score >= search.full_score) {
+        dst.emplace_back(code);
+    } else if (search.num_ties > 0) {
+        dst.emplace_back(code);
+        if (--search.num_ties == 0) {
+            search.score_threshold = search.full_score;
+        }
     }
 }
 
-std::vector<uint32_t> createKmerVector(const std::unique_ptr<Chain>& chain,
-    uint32_t kmer_length) {
+/* branch-and-bound over positions, a branch is cut as soon as the best score
+ * its remaining positions can reach is below the threshold (the bound can be
+ * reached, therefore the search visits only prefixes of neighbours) */
+static void findNeighboursRecursive(std::vector<uint32_t>& dst,
+    NeighbourhoodSearch& search, uint32_t position, int score, uint32_t code) {
 
-    if (chain->length() < kmer_length) {
-        return std::vector<uint32_t>();
+    const auto& row = search.rows[search.kmer[position]];
+
+    /* the last position is expanded in place, half of all nodes are leaves */
+    if (position + 1 == search.kmer_length) {
+        for (const auto& it: row) {
+            if (score + it.first < search.score_threshold) {
+                break;
+            }
+            addNeighbour(dst, search, score + it.first,
+                (code << search.bits) | kAminoAcids[it.second]);
+        }
+        return;
     }
 
-    auto data = chain->data();
+    for (const auto& it: row) {
 
-    std::vector<uint32_t> res(data.size() - kmer_length + 1);
-    uint32_t ptr = 0, kmer = 0, del_mask = kDelMask[kmer_length];
+        if (score + it.first + search.bounds[position + 1] < search.score_threshold) {
+            break;
+        }
 
-    for (uint32_t i = 0; i < kmer_length; ++i) {
-        kmer = (kmer << kProtBitLength) | data[i];
+        findNeighboursRecursive(dst, search, position + 1, score + it.first,
+            (code << search.bits) | kAminoAcids[it.second]);
     }
-    res[ptr++] = kmer;
+}
 
-    for (uint32_t i = kmer_length; i < data.size(); ++i) {
-        kmer = ((kmer << kProtBitLength) | data[i]) & del_mask;
-        res[ptr++] = kmer;
+/* neighbourhoods of kmers of amino acids starting with kAminoAcids[first],
+ * in ascending order of their codes */
+struct NeighbourhoodsPart {
+    std::vector<uint32_t> codes;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> substitutions;
+};
+
+static void createNeighbourhoodsPart(NeighbourhoodsPart& dst, uint32_t first,
+    uint32_t kmer_length, uint32_t bits, int score_threshold,
+    uint32_t max_neighbours,
+    const std::vector<std::vector<std::pair<int, uint32_t>>>& rows) {
+
+    /* if neighbourhoods are limited, the number of kmers reaching each score
+     * is counted by convolving score histograms of rows, histograms[i][j] is
+     * the number of kmers of length i (equal to the kmer prefix of length i)
+     * scoring min_score * i + j against it */
+    int min_score = 0, max_score = 0;
+    for (const auto& row: rows) {
+        min_score = std::min(min_score, row.back().first);
+        max_score = std::max(max_score, row.front().first);
+    }
+    uint32_t range = max_score - min_score + 1;
+
+    std::vector<uint32_t> self_scores(rows.size(), 0);
+    std::vector<std::vector<uint32_t>> row_histograms(rows.size(),
+        std::vector<uint32_t>(range, 0));
+    for (uint32_t i = 0; i < rows.size(); ++i) {
+        for (const auto& it: rows[i]) {
+            ++row_histograms[i][it.first - min_score];
+            if (it.second == i) {
+                self_scores[i] = it.first;
+            }
+        }
     }
 
-    return res;
-}
+    std::vector<std::vector<uint32_t>> histograms(kmer_length + 1);
+    for (uint32_t i = 0; i <= kmer_length; ++i) {
+        histograms[i].resize(i * (range - 1) + 1, 0);
+    }
+    histograms[0][0] = 1;
 
-std::unique_ptr<Kmers> createKmers(uint32_t kmer_length, uint32_t score_threshold,
-    std::shared_ptr<ScoreMatrix> score_matrix) {
+    std::vector<uint32_t> kmer(kmer_length, 0);
+    std::vector<int> bounds(kmer_length + 1, 0);
+    kmer[0] = first;
+    uint32_t changed = 0;
 
-    assert(kmer_length > 2);
-    assert(kmer_length < 6);
-    assert(score_matrix);
+    NeighbourhoodSearch search = { rows, kmer.data(), bounds.data(), 0,
+        kmer_length, bits, score_threshold, score_threshold, 0 };
 
-    return std::unique_ptr<Kmers>(new Kmers(kmer_length, score_threshold, score_matrix));
-}
+    while (true) {
+
+        search.code = 0;
+        int self_score = 0;
+        for (uint32_t i = 0; i < kmer_length; ++i) {
+            search.code = (search.code << bits) | kAminoAcids[kmer[i]];
+            self_score += self_scores[kmer[i]];
+        }
+        for (uint32_t i = kmer_length; i > 0; --i) {
+            bounds[i - 1] = bounds[i] + rows[kmer[i - 1]].front().first;
+        }
+
+        search.score_threshold = score_threshold;
+        search.full_score = score_threshold;
+        search.num_ties = 0;
+
+        if (max_neighbours > 0) {
+
+            for (uint32_t i = changed; i < kmer_length; ++i) {
+                const auto& src = histograms[i];
+                const auto& row = row_histograms[kmer[i]];
+                auto& histogram = histograms[i + 1];
+                std::fill(histogram.begin(), histogram.end(), 0);
+                for (uint32_t j = 0; j < src.size(); ++j) {
+                    if (src[j] == 0) {
+                        continue;
+                    }
+                    for (uint32_t k = 0; k < range; ++k) {
+                        histogram[j + k] += src[j] * row[k];
+                    }
+                }
+            }
+
+            /* scores are walked downwards until more than max_neighbours
+             * kmers (the kmer itself excluded) reach them */
+            const auto& histogram = histograms[kmer_length];
+            uint32_t num_neighbours = 0;
+            for (int32_t j = histogram.size() - 1; j >= 0; --j) {
+                int score = j + min_score * static_cast<int>(kmer_length);
+                if (score < score_threshold) {
+                    break;
+                }
+                auto n = num_neighbours + histogram[j] - (score == self_score);
+                if (n > max_neighbours) {
+                    search.score_threshold = score;
+                    search.full_score = score + 1;
+                    search.num_ties = max_neighbours - num_neighbours;
+                    break;
+                }
+                num_neighbours = n;
+            }
+        }
 
-Kmers::Kmers(uint32_t kmer_length, uint32_t score_threshold, std::shared_ptr<ScoreMatrix> score_matrix) {
+        auto size = dst.substitutions.size();
+        findNeighboursRecursive(dst.substitutions, search, 0, 0, 0);
 
-    kmer_length_ = kmer_length;
-    data_.resize(numKmers(kmer_length));
+        dst.codes.emplace_back(search.code);
+        dst.sizes.emplace_back(dst.substitutions.size() - size);
 
-    if (score_threshold > 0) {
-        if (kmer_length_ == 3) {
-            createSubstitutionsLong(score_threshold, score_matrix);
-        } else {
-            createSubstitutionsShort(score_threshold, score_matrix);
+        /* next kmer with the same first amino acid */
+        uint32_t i = kmer_length - 1;
+        for (; i > 0 && kmer[i] == kAminoAcids.size() - 1; --i) {
+            kmer[i] = 0;
         }
+        if (i == 0) {
+            break;
+        }
+        ++kmer[i];
+        changed = i;
     }
 }
 
-const std::vector<uint32_t>& Kmers::kmer_substitutions(uint32_t kmer) const {
-    return data_[kmer];
+uint32_t seedCode(uint64_t window, uint32_t seed, uint32_t bits) {
+
+    uint32_t code = 0, shift = 0;
+
+    /* runs of set bits are copied at once */
+    while (seed != 0) {
+        while ((seed & 1) == 0) {
+            seed >>= 1;
+            window >>= bits;
+        }
+
+        uint32_t run = 0;
+        for (; (seed & 1) == 1; seed >>= 1) {
+            ++run;
+        }
+
+        code |= (window & ((1ULL << (run * bits)) - 1)) << shift;
+        window >>= run * bits;
+        shift += run * bits;
+    }
+
+    return code;
 }
 
-void Kmers::createSubstitutionsShort(int score_threshold, std::shared_ptr<ScoreMatrix> score_matrix) {
+/* specialized for seeds in specializeSeed, KmerVector<0, 0> works for any
+ * seed */
+template<uint32_t kSeed, uint32_t kBits>
+struct KmerVector {
+
+    static void run(std::vector<uint32_t>& dst, const std::string& data,
+        const char* residue_map, uint32_t seed_, uint32_t bits_) {
 
-    std::vector<std::string> kmers;
-    std::string starting_kmer = "";
-    createKmersRecursive(kmers, starting_kmer, kmer_length_);
+        const uint32_t seed = kSeed ? kSeed : seed_;
+        const uint32_t bits = kBits ? kBits : bits_;
+        const uint32_t span = seedSpan(seed);
 
-    for (const auto& kmer_a: kmers) {
-        for (size_t i = 0; i < kmer_length_; ++i) {
+        dst.clear();
 
-            auto kmer_b = kmer_a;
+        if (data.size() < span) {
+            return;
+        }
 
-            for (const auto& aa: kAminoAcids) {
+        dst.resize(data.size() - span + 1);
+        uint32_t ptr = 0;
+        uint64_t window = 0;
 
-                if (kmer_a[i] == aa) {
-                    continue;
-                }
+        for (uint32_t i = 0; i < span - 1; ++i) {
+            window = (window << bits) | residue_map[static_cast<uint8_t>(data[i])];
+        }
 
-                kmer_b[i] = aa;
+        for (uint32_t i = span - 1; i < data.size(); ++i) {
+            window = (window << bits) | residue_map[static_cast<uint8_t>(data[i])];
+            dst[ptr++] = kSeed ? SeedCode<kSeed, kBits>::get(window) :
+                seedCode(window, seed, bits);
+        }
+    }
+};
 
-                int score = 0;
-                for (uint32_t j = 0; j < kmer_length_; ++j) {
-                    score += score_matrix->score(kmer_a[j], kmer_b[j]);
-                }
+void maskKmers(uint32_t* kmers, uint32_t num_kmers,
+    const Intervals& low_complexity, uint32_t span, uint32_t value) {
 
-                if (score >= score_threshold) {
-                    data_[kmer_code(kmer_a)].emplace_back(kmer_code(kmer_b));
-                }
-            }
+    for (const auto& it: low_complexity) {
+        uint32_t begin = it.first + 1 > span ? it.first + 1 - span : 0;
+        uint32_t end = std::min(it.second, num_kmers);
+        for (uint32_t i = begin; i < end; ++i) {
+            kmers[i] = value;
         }
     }
 }
 
-void Kmers::createSubstitutionsLong(int score_threshold, std::shared_ptr<ScoreMatrix> score_matrix) {
+std::vector<uint32_t> createKmerVector(const std::unique_ptr<Chain>& chain,
+    std::shared_ptr<Kmers> kmers, uint32_t seed) {
+
+    std::vector<uint32_t> res;
+    kmers->kmer_vector(res, chain->data(), seed);
+
+    return res;
+}
+
+std::string checkKmers(uint32_t kmer_length, AlphabetType alphabet,
+    const std::vector<uint32_t>& seeds) {
 
-    std::vector<std::string> kmers;
-    std::string starting_kmer = "";
-    createKmersRecursive(kmers, starting_kmer, kmer_length_);
+    uint32_t max_kmer_length = alphabet == AlphabetType::kFull ? 5 : 6;
+    if (kmer_length < 3 || kmer_length > max_kmer_length) {
+        return "kmer length must be between 3 and " +
+            std::to_string(max_kmer_length);
+    }
 
-    for (uint32_t i = 0; i < kmers.size(); ++i) {
+    for (const auto& it: seeds) {
+        if (seedWeight(it) != kmer_length) {
+            return "seeds must have as many ones as the kmer length " +
+                std::to_string(kmer_length);
+        }
+        if (seedSpan(it) > kMaxSeedSpan || (it & 1) == 0) {
+            return "seeds must begin and end with 1 and span at most " +
+                std::to_string(kMaxSeedSpan);
+        }
+    }
 
-        const auto& kmer_a = kmers[i];
+    return std::string();
+}
 
-        for (uint32_t j = i + 1; j < kmers.size(); ++j) {
+std::unique_ptr<Kmers> createKmers(uint32_t kmer_length, uint32_t score_threshold,
+    std::shared_ptr<ScoreMatrix> score_matrix, AlphabetType alphabet,
+    const std::vector<uint32_t>& seeds, uint32_t max_neighbours,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    assert(score_matrix);
 
-            const auto& kmer_b = kmers[j];
+    auto error = checkKmers(kmer_length, alphabet, seeds);
+    if (!error.empty()) {
+        kmersError(error);
+    }
 
-            int score = 0;
+    return std::unique_ptr<Kmers>(new Kmers(kmer_length, score_threshold,
+        score_matrix, alphabet, seeds, max_neighbours, thread_pool));
+}
 
-            for (uint32_t k = 0; k < kmer_length_; ++k) {
-                score += score_matrix->score(kmer_a[k], kmer_b[k]);
-            }
+Kmers::Kmers(uint32_t kmer_length, uint32_t score_threshold,
+    std::shared_ptr<ScoreMatrix> score_matrix, AlphabetType alphabet,
+    const std::vector<uint32_t>& seeds, uint32_t max_neighbours,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool)
+        : kmer_length_(kmer_length), alphabet_(alphabet), residue_map_(),
+        residue_bits_(kReducedBitLength), num_kmers_(0), seeds_(seeds),
+        span_(kMaxSeedSpan), kmer_vector_functions_(), substitution_starts_(),
+        substitutions_(), neighbourhood_size_(1) {
+
+    if (seeds_.empty()) {
+        seeds_.emplace_back((1U << kmer_length_) - 1);
+    }
+
+    for (const auto& it: seeds_) {
+        span_ = std::min(span_, seedSpan(it));
+    }
 
-            if (score >= score_threshold) {
-                auto a = kmer_code(kmer_a);
-                auto b = kmer_code(kmer_b);
-                data_[a].emplace_back(b);
-                data_[b].emplace_back(a);
+    switch (alphabet_) {
+        case AlphabetType::kMurphy10:
+            residue_map_ = kMurphy10Map;
+            break;
+        case AlphabetType::kSeB14:
+            residue_map_ = kSeB14Map;
+            break;
+        case AlphabetType::kFull:
+        default:
+            for (char i = 0; i < 26; ++i) {
+                residue_map_.emplace_back(i);
             }
+            residue_bits_ = kProtBitLength;
+            break;
+    }
+
+    auto max_value = *std::max_element(residue_map_.begin(), residue_map_.end());
+    num_kmers_ = numKmers(kmer_length_, max_value, residue_bits_);
+
+    for (const auto& it: seeds_) {
+        kmer_vector_functions_.emplace_back(specializeSeed<KmerVector>(it,
+            residue_bits_));
+    }
+
+    /* neighbourhoods are defined by the score matrix, which has no meaning for
+     * classes of reduced alphabets */
+    if (score_threshold > 0 && alphabet_ == AlphabetType::kFull) {
+        createSubstitutions(score_threshold, max_neighbours, score_matrix,
+            thread_pool);
+
+        /* averaged over kmers with a neighbourhood only, codes of invalid
+         * kmers (e.g. with residues outside of the score matrix) have none */
+        size_t num_nonempty = 0;
+        for (uint32_t i = 0; i < num_kmers_; ++i) {
+            num_nonempty += substitution_starts_[i + 1] != substitution_starts_[i];
+        }
+        if (num_nonempty > 0) {
+            neighbourhood_size_ += substitutions_.size() / (double) num_nonempty;
+        }
+    }
+}
+
+void Kmers::createSubstitutions(int score_threshold, uint32_t max_neighbours,
+    std::shared_ptr<ScoreMatrix> score_matrix,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    std::vector<std::vector<std::pair<int, uint32_t>>> rows(kAminoAcids.size());
+    for (uint32_t i = 0; i < kAminoAcids.size(); ++i) {
+        for (uint32_t j = 0; j < kAminoAcids.size(); ++j) {
+            rows[i].emplace_back(score_matrix->score(kAminoAcids[i],
+                kAminoAcids[j]), j);
+        }
+        std::stable_sort(rows[i].begin(), rows[i].end(),
+            [](const std::pair<int, uint32_t>& a, const std::pair<int, uint32_t>& b) {
+                return a.first > b.first;
+            });
+    }
+
+    std::vector<NeighbourhoodsPart> parts(kAminoAcids.size());
+
+    if (thread_pool) {
+        std::vector<std::future<void>> thread_futures;
+        for (uint32_t i = 0; i < parts.size(); ++i) {
+            thread_futures.emplace_back(thread_pool->submit(createNeighbourhoodsPart,
+                std::ref(parts[i]), i, kmer_length_, residue_bits_,
+                score_threshold, max_neighbours, std::cref(rows)));
+        }
+        for (const auto& it: thread_futures) {
+            it.wait();
+        }
+    } else {
+        for (uint32_t i = 0; i < parts.size(); ++i) {
+            createNeighbourhoodsPart(parts[i], i, kmer_length_, residue_bits_,
+                score_threshold, max_neighbours, rows);
         }
     }
+
+    /* parts are ordered by code, so their substitutions can be concatenated */
+    substitution_starts_.assign(num_kmers_ + 1, 0);
+    size_t num_substitutions = 0;
+    for (const auto& it: parts) {
+        for (uint32_t i = 0; i < it.codes.size(); ++i) {
+            substitution_starts_[it.codes[i] + 1] = it.sizes[i];
+        }
+        num_substitutions += it.substitutions.size();
+    }
+    for (uint32_t i = 0; i < num_kmers_; ++i) {
+        substitution_starts_[i + 1] += substitution_starts_[i];
+    }
+
+    substitutions_.reserve(num_substitutions);
+    for (auto& it: parts) {
+        substitutions_.insert(substitutions_.end(), it.substitutions.begin(),
+            it.substitutions.end());
+        std::vector<uint32_t>().swap(it.substitutions);
+    }
 }
 
 uint32_t Kmers::kmer_code(const std::string& kmer) const {
@@ -166,8 +479,8 @@ uint32_t Kmers::kmer_code(const std::string& kmer) const {
     uint32_t code = 0;
 
     for (const auto& it: kmer) {
-        code <<= kProtBitLength;
-        code |= it;
+        code <<= residue_bits_;
+        code |= residue_map_[it];
     }
 
     return code;
@@ -6,20 +6,226 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <string>
 #include <memory>
 #include <vector>
 
+namespace thread_pool {
+    class ThreadPool;
+}
+
 class ScoreMatrix;
 class Chain;
 class Hash;
 class Kmers;
 
+using Intervals = std::vector<std::pair<uint32_t, uint32_t>>;
+
+/*!
+ * @brief Alphabets in which kmers are formed (used only for the database
+ * search, alignment is always done with the full alphabet)
+ */
+enum class AlphabetType {
+    kFull, // all 26 chain codes
+    kMurphy10, // Murphy et al. 2000 (LVIM, C, A, G, ST, P, FYW, EDNQ, KR, H)
+    kSeB14 // SE-B(14), Peterson et al. 2009 (A, C, D, EQ, FY, G, H, IV, KR,
+           // LM, N, P, ST, W)
+};
+
+/*!
+ * @brief Seeds are bit patterns of residues which form a kmer, read from the
+ * most significant set bit (e.g. 0b1101 for 11-1, the third residue is
+ * skipped); contiguous kmers of length k are seeds with k set bits
+ */
+constexpr uint32_t kMaxSeedSpan = 12;
+
+constexpr uint32_t seedSpan(uint32_t seed) {
+    return seed == 0 ? 0 : 1 + seedSpan(seed >> 1);
+}
+
+constexpr uint32_t seedWeight(uint32_t seed) {
+    return seed == 0 ? 0 : (seed & 1) + seedWeight(seed >> 1);
+}
+
+constexpr uint32_t trailingZeros(uint32_t x) {
+    return x == 0 || (x & 1) ? 0 : 1 + trailingZeros(x >> 1);
+}
+
+constexpr uint32_t trailingOnes(uint32_t x) {
+    return (x & 1) ? 1 + trailingOnes(x >> 1) : 0;
+}
+
+/*!
+ * @brief Extracts the kmer code of seed from window which holds the last
+ * seedSpan(seed) residues (bits per residue)
+ */
+uint32_t seedCode(uint64_t window, uint32_t seed, uint32_t bits);
+
+/*!
+ * @brief Compile time version of seedCode, each run of set bits of the seed
+ * is copied with one shift and mask
+ */
+template<uint32_t kSeed, uint32_t kBits>
+struct SeedCode {
+
+    static constexpr uint32_t kZeros = trailingZeros(kSeed);
+    static constexpr uint32_t kOnes = trailingOnes(kSeed >> kZeros);
+
+    static uint32_t get(uint64_t window) {
+        return ((window >> (kZeros * kBits)) & ((1ULL << (kOnes * kBits)) - 1)) |
+            (SeedCode<(kSeed >> (kZeros + kOnes)), kBits>::get(window >>
+                ((kZeros + kOnes) * kBits)) << (kOnes * kBits));
+    }
+};
+
+template<uint32_t kBits>
+struct SeedCode<0, kBits> {
+
+    static uint32_t get(uint64_t) {
+        return 0;
+    }
+};
+
+/*!
+ * @brief Returns F<seed, bits>::run for the seeds and residue widths (4 and
+ * 5 bits) the search is specialized for, otherwise F<0, 0>::run which has to
+ * handle any seed (F<kSeed, kBits> gets the seed and bits at run time too)
+ */
+template<template<uint32_t, uint32_t> class F, uint32_t kBits>
+decltype(&F<0, 0>::run) specializeSeed(uint32_t seed) {
+
+    switch (seed) {
+        /* contiguous */
+        case 0x7: // 111
+            return F<0x7, kBits>::run;
+        case 0xF: // 1111
+            return F<0xF, kBits>::run;
+        case 0x1F: // 11111
+            return F<0x1F, kBits>::run;
+        case 0x3F: // 111111
+            return F<0x3F, kBits>::run;
+        /* spaced, weight 3 */
+        case 0xD: // 1101
+            return F<0xD, kBits>::run;
+        case 0xB: // 1011
+            return F<0xB, kBits>::run;
+        case 0x19: // 11001
+            return F<0x19, kBits>::run;
+        case 0x13: // 10011
+            return F<0x13, kBits>::run;
+        /* spaced, weight 4 */
+        case 0x1B: // 11011
+            return F<0x1B, kBits>::run;
+        case 0x35: // 110101
+            return F<0x35, kBits>::run;
+        case 0x2B: // 101011
+            return F<0x2B, kBits>::run;
+        case 0x33: // 110011
+            return F<0x33, kBits>::run;
+        /* spaced, weight 5 */
+        case 0x6B: // 1101011
+            return F<0x6B, kBits>::run;
+        case 0x75: // 1110101
+            return F<0x75, kBits>::run;
+        case 0x5B: // 1011011
+            return F<0x5B, kBits>::run;
+        default:
+            return F<0, 0>::run;
+    }
+}
+
+template<template<uint32_t, uint32_t> class F>
+decltype(&F<0, 0>::run) specializeSeed(uint32_t seed, uint32_t bits) {
+
+    switch (bits) {
+        case 4:
+            return specializeSeed<F, 4>(seed);
+        case 5:
+            return specializeSeed<F, 5>(seed);
+        default:
+            return F<0, 0>::run;
+    }
+}
+
+/*!
+ * @brief Default of max_neighbours for createKmers, neighbourhoods of kmers of
+ * length 3 are small enough to be kept whole
+ */
+constexpr uint32_t kDefaultMaxNeighbours = 100;
+
+constexpr uint32_t defaultMaxNeighbours(uint32_t kmer_length) {
+    return kmer_length == 3 ? 0 : kDefaultMaxNeighbours;
+}
+
+/*!
+ * @brief Returns why kmers of kmer_length and seeds can not be created in
+ * alphabet, or an empty string if they can
+ */
+std::string checkKmers(uint32_t kmer_length, AlphabetType alphabet,
+    const std::vector<uint32_t>& seeds);
+
+/*!
+ * @brief Kmers of reduced alphabets are matched only exactly (score_threshold
+ * is ignored), and can be up to 6 residues long (full alphabet up to 5)
+ * @details Kmers are formed with given seeds (all with kmer_length set bits),
+ * if none are given a contiguous seed of kmer_length is used. The neighbourhood
+ * of a kmer contains all kmers scoring at least score_threshold against it,
+ * limited to the max_neighbours best of them (0 for no limit). Neighbourhoods
+ * are built in parallel if a thread pool is given. Exits with an error if
+ * kmer_length or the seeds are invalid (see checkKmers).
+ */
 std::unique_ptr<Kmers> createKmers(uint32_t kmer_length, uint32_t score_threshold,
-    std::shared_ptr<ScoreMatrix> score_matrix);
+    std::shared_ptr<ScoreMatrix> score_matrix,
+    AlphabetType alphabet = AlphabetType::kFull,
+    const std::vector<uint32_t>& seeds = std::vector<uint32_t>(),
+    uint32_t max_neighbours = 0,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
 
+/*!
+ * @brief Creates codes of kmers of chain formed with seed kmers->seeds()[seed]
+ */
 std::vector<uint32_t> createKmerVector(const std::unique_ptr<Chain>& chain,
-    uint32_t kmer_length);
+    std::shared_ptr<Kmers> kmers, uint32_t seed = 0);
+
+/*!
+ * @brief Sets codes of kmers (formed with a seed of given span) which overlap
+ * any of the low complexity intervals (see Chain::low_complexity) to value
+ */
+void maskKmers(uint32_t* kmers, uint32_t num_kmers,
+    const Intervals& low_complexity, uint32_t span, uint32_t value);
+
+/*!
+ * @brief Codes of kmers similar to a kmer (a view into Kmers)
+ */
+class KmerSubstitutions {
+public:
+
+    KmerSubstitutions(const uint32_t* begin, const uint32_t* end)
+            : begin_(begin), end_(end) {
+    }
+
+    const uint32_t* begin() const {
+        return begin_;
+    }
+
+    const uint32_t* end() const {
+        return end_;
+    }
+
+    size_t size() const {
+        return end_ - begin_;
+    }
+
+    bool empty() const {
+        return begin_ == end_;
+    }
+
+private:
+
+    const uint32_t* begin_;
+    const uint32_t* end_;
+};
 
 class Kmers {
 public:
@@ -30,29 +236,107 @@ public:
         return kmer_length_;
     }
 
-    const std::vector<uint32_t>& kmer_substitutions(uint32_t kmer) const;
+    AlphabetType alphabet() const {
+        return alphabet_;
+    }
+
+    /*!
+     * @brief Maps chain codes to residue codes of the alphabet
+     */
+    const std::vector<char>& residue_map() const {
+        return residue_map_;
+    }
 
-    const std::vector<uint32_t>& kmer_substitutions(const std::string& kmer) const {
+    /*!
+     * @brief Number of bits used for one residue in kmer codes
+     */
+    uint32_t residue_bits() const {
+        return residue_bits_;
+    }
+
+    /*!
+     * @brief Kmer codes are smaller than num_kmers()
+     */
+    size_t num_kmers() const {
+        return num_kmers_;
+    }
+
+    const std::vector<uint32_t>& seeds() const {
+        return seeds_;
+    }
+
+    /*!
+     * @brief Shortest span of all seeds
+     */
+    uint32_t span() const {
+        return span_;
+    }
+
+    /*!
+     * @brief Stores codes of kmers of data formed with seeds()[seed] into dst
+     */
+    void kmer_vector(std::vector<uint32_t>& dst, const std::string& data,
+        uint32_t seed) const {
+        kmer_vector_functions_[seed](dst, data, residue_map_.data(),
+            seeds_[seed], residue_bits_);
+    }
+
+    /*!
+     * @brief Average number of kmers (including itself) a kmer is similar to,
+     * i.e. number of hash entries a query position creates per seed
+     */
+    double neighbourhood_size() const {
+        return neighbourhood_size_;
+    }
+
+    /*!
+     * @brief Kmers (other than kmer) which score at least score_threshold
+     * against kmer
+     */
+    KmerSubstitutions kmer_substitutions(uint32_t kmer) const {
+        if (substitution_starts_.empty()) {
+            return KmerSubstitutions(nullptr, nullptr);
+        }
+        return KmerSubstitutions(substitutions_.data() + substitution_starts_[kmer],
+            substitutions_.data() + substitution_starts_[kmer + 1]);
+    }
+
+    KmerSubstitutions kmer_substitutions(const std::string& kmer) const {
         return kmer_substitutions(kmer_code(kmer));
     }
 
     friend std::unique_ptr<Kmers> createKmers(uint32_t kmer_length, uint32_t score_threshold,
-        std::shared_ptr<ScoreMatrix> score_matrix);
+        std::shared_ptr<ScoreMatrix> score_matrix, AlphabetType alphabet,
+        const std::vector<uint32_t>& seeds, uint32_t max_neighbours,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
 
     friend Hash;
 
 private:
 
-    Kmers(uint32_t kmer_length, uint32_t score_threshold, std::shared_ptr<ScoreMatrix> score_matrix);
+    Kmers(uint32_t kmer_length, uint32_t score_threshold,
+        std::shared_ptr<ScoreMatrix> score_matrix, AlphabetType alphabet,
+        const std::vector<uint32_t>& seeds, uint32_t max_neighbours,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
     Kmers(const Kmers&) = delete;
     const Kmers& operator=(const Kmers&) = delete;
 
-    void createSubstitutionsShort(int score_threshold, std::shared_ptr<ScoreMatrix> score_matrix);
-
-    void createSubstitutionsLong(int score_threshold, std::shared_ptr<ScoreMatrix> score_matrix);
+    void createSubstitutions(int score_threshold, uint32_t max_neighbours,
+        std::shared_ptr<ScoreMatrix> score_matrix,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
 
     uint32_t kmer_code(const std::string& kmer) const;
 
     uint32_t kmer_length_;
-    std::vector<std::vector<uint32_t>> data_;
+    AlphabetType alphabet_;
+    std::vector<char> residue_map_;
+    uint32_t residue_bits_;
+    size_t num_kmers_;
+    std::vector<uint32_t> seeds_;
+    uint32_t span_;
+    std::vector<void (*)(std::vector<uint32_t>&, const std::string&,
+        const char*, uint32_t, uint32_t)> kmer_vector_functions_;
+    std::vector<uint32_t> substitution_starts_;
+    std::vector<uint32_t> substitutions_;
+    double neighbourhood_size_;
 };
@@ -2,19 +2,32 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include <memory>
+#include <algorithm>
+#include <fstream>
 
 #include "thread_pool/thread_pool.hpp"
 
+#include "chain.hpp"
+#include "reader.hpp"
+#include "kmers.hpp"
+#include "index.hpp"
 #include "writer.hpp"
 #include "evalue.hpp"
 #include "score_matrix.hpp"
 #include "database_search.hpp"
 #include "database_alignment.hpp"
+#include "shard.hpp"
+#include "searcher.hpp"
+#include "memory.hpp"
+#include "server.hpp"
 #include "utils.hpp"
 
 static const char* version = "v1.0.4";
 
+constexpr uint32_t kDefaultBatchSize = 1000;
+
 static struct option options[] = {
     {"query", required_argument, 0, 'i'},
     {"target", required_argument, 0, 'j'},
@@ -28,8 +41,19 @@ static struct option options[] = {
     {"algorithm", required_argument, 0, 'A'},
     {"kmer-length", required_argument, 0, 'k'},
     {"max-candidates", required_argument, 0, 'c'},
+    {"candidates-zscore", required_argument, 0, 'Z'},
     {"threshold", required_argument, 0, 'T'},
+    {"max-neighbours", required_argument, 0, 'N'},
+    {"alphabet", required_argument, 0, 'R'},
+    {"seed", required_argument, 0, 'S'},
     {"threads", required_argument, 0, 't'},
+    {"batch-size", required_argument, 0, 'b'},
+    {"dedup-targets", no_argument, 0, 'D'},
+    {"mask", no_argument, 0, 'M'},
+    {"shard", required_argument, 0, 'P'},
+    {"socket", required_argument, 0, 'U'},
+    {"pipeline", no_argument, 0, 'L'},
+    {"memory-limit", required_argument, 0, 'X'},
     {"version", no_argument, 0, 'V'},
     {"help", no_argument, 0, 'h'},
     {0, 0, 0, 0}
@@ -41,10 +65,43 @@ ScoreMatrixType strToScorerType(const std::string& str);
 
 AlignmentType strToAlignmentType(const std::string& str);
 
+AlphabetType strToAlphabetType(const std::string& str);
+
+std::vector<uint32_t> strToSeeds(const std::string& str);
+
+bool isStream(const std::string& path);
+
+bool strToShard(const std::string& str, uint32_t& shard, uint32_t& num_shards);
+
+uint64_t strToMemory(const std::string& str);
+
+int indexMain(int argc, char* argv[]);
+
+int mergeMain(int argc, char* argv[]);
+
 void help();
 
+void indexHelp();
+
+void mergeHelp();
+
 int main(int argc, char* argv[]) {
 
+    if (argc > 1 && std::string(argv[1]) == "index") {
+        return indexMain(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        return mergeMain(argc - 1, argv + 1);
+    }
+
+    /* sword serve takes the same arguments as a search, except for queries */
+    bool is_server = false;
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        is_server = true;
+        --argc;
+        ++argv;
+    }
+
     auto threads = std::thread::hardware_concurrency() / 2;
 
     int32_t gap_open = 10;
@@ -65,10 +122,28 @@ int main(int argc, char* argv[]) {
 
     uint32_t kmer_length = 3;
     uint32_t max_candidates = 30000;
+    double candidates_zscore = 0;
     uint32_t threshold = 13;
+    int32_t max_neighbours = -1;
+    AlphabetType alphabet = AlphabetType::kFull;
+    std::vector<uint32_t> seeds;
+
+    uint32_t batch_size = 0;
+
+    bool dedup_targets = false;
+    bool mask_low_complexity = false;
+
+    uint32_t shard = 0;
+    uint32_t num_shards = 0;
+
+    std::string socket_path;
+
+    bool pipeline = false;
+
+    uint64_t memory_limit = 0;
 
     char opt;
-    while ((opt = getopt_long(argc, argv, "i:j:g:e:m:o:f:v:a:A:k:c:T:t:h", options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:j:g:e:m:o:f:v:a:A:k:c:T:t:b:h", options, nullptr)) != -1) {
 
         switch (opt) {
         case 'i':
@@ -107,12 +182,52 @@ int main(int argc, char* argv[]) {
         case 'c':
             max_candidates = atoi(optarg);
             break;
+        case 'Z':
+            candidates_zscore = atof(optarg);
+            break;
         case 'T':
             threshold = atoi(optarg);
             break;
+        case 'N':
+            max_neighbours = atoi(optarg);
+            break;
+        case 'R':
+            alphabet = strToAlphabetType(optarg);
+            break;
+        case 'S':
+            seeds = strToSeeds(optarg);
+            break;
         case 't':
             threads = atoi(optarg);
             break;
+        case 'b':
+            batch_size = atoi(optarg);
+            break;
+        case 'D':
+            dedup_targets = true;
+            break;
+        case 'M':
+            mask_low_complexity = true;
+            break;
+        case 'P':
+            if (!strToShard(optarg, shard, num_shards)) {
+                fprintf(stderr, "[sword::] error: invalid shard %s!\n", optarg);
+                return 1;
+            }
+            break;
+        case 'U':
+            socket_path = optarg;
+            break;
+        case 'L':
+            pipeline = true;
+            break;
+        case 'X':
+            memory_limit = strToMemory(optarg);
+            if (memory_limit == 0) {
+                fprintf(stderr, "[sword::] error: invalid memory limit %s!\n", optarg);
+                return 1;
+            }
+            break;
         case 'V':
             printf("%s\n", version);
             return 0;
@@ -124,7 +239,13 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (queries_path.empty()) {
+    if (is_server && (socket_path.empty() || num_shards > 0 ||
+        !queries_path.empty())) {
+        fprintf(stderr, "[sword::] error: sword serve needs a socket and "
+            "accepts neither queries nor shards!\n");
+        return 1;
+    }
+    if (queries_path.empty() && !is_server) {
         fprintf(stderr, "[sword::] error: missing input queries file!\n");
         help();
         return 1;
@@ -135,32 +256,298 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (num_shards > 0 && output_path.empty()) {
+        fprintf(stderr, "[sword::] error: missing output file for shard results!\n");
+        return 1;
+    }
+    if (num_shards > 0 && (batch_size > 0 || isStream(queries_path))) {
+        fprintf(stderr, "[sword::] error: shards cannot be searched in "
+            "streaming mode!\n");
+        return 1;
+    }
+    if (pipeline && (num_shards > 0 || candidates_zscore > 0)) {
+        fprintf(stderr, "[sword::] error: pipelined search cannot be used "
+            "with shards or candidates zscore!\n");
+        return 1;
+    }
+
     std::shared_ptr<thread_pool::ThreadPool> thread_pool = thread_pool::createThreadPool(threads);
 
     std::shared_ptr<ScoreMatrix> scorer = createScoreMatrix(scorer_type,
         gap_open, gap_extend);
 
+    if (!seeds.empty()) {
+        kmer_length = seedWeight(seeds.front());
+    }
+
+    if (max_neighbours < 0) {
+        max_neighbours = defaultMaxNeighbours(kmer_length);
+    }
+
     Timer timer;
     timer.start();
 
-    Indexes indexes;
-    auto database_cells = searchDatabase(indexes, database_path, queries_path,
-        kmer_length, max_candidates, scorer, threshold, thread_pool);
+    if (batch_size == 0 && (is_server || isStream(queries_path))) {
+        batch_size = kDefaultBatchSize;
+    }
 
-    timer.stop();
-    timer.print("database", "search");
-    timer.reset();
-    timer.start();
+    if (batch_size > 0) {
+
+        /* streaming mode: the database stays in memory and queries are
+         * searched and aligned in batches as they arrive */
+        if (memory_limit > 0) {
+            fprintf(stderr, "[sword::] warning: memory limit is not applied "
+                "when the database is kept in memory!\n");
+        }
+
+        SearchOptions search_options;
+        search_options.matrix = scorer_type;
+        search_options.gap_open = gap_open;
+        search_options.gap_extend = gap_extend;
+        search_options.algorithm = algorithm;
+        search_options.max_evalue = max_evalue;
+        search_options.max_alignments = max_alignments;
+        search_options.kmer_length = kmer_length;
+        search_options.max_candidates = max_candidates;
+        search_options.candidates_zscore = candidates_zscore;
+        search_options.threshold = threshold;
+        search_options.max_neighbours = max_neighbours;
+        search_options.alphabet = alphabet;
+        search_options.seeds = seeds;
+        search_options.dedup_targets = dedup_targets;
+        search_options.mask_low_complexity = mask_low_complexity;
+
+        std::string error;
+        auto searcher = createSearcher(database_path, search_options, error,
+            thread_pool);
+        if (searcher == nullptr) {
+            fprintf(stderr, "[sword::] error: %s!\n", error.c_str());
+            return 1;
+        }
+
+        timer.stop();
+        timer.print("database", "load");
+        timer.reset();
+
+        if (is_server) {
+            serveDatabase(socket_path, *searcher, output_format, batch_size);
+            return 0;
+        }
+
+        auto writer = createWriter(output_path, output_format,
+            searcher->scorer());
+
+        std::shared_ptr<Reader> reader = createChainSetPartInitialize(queries_path,
+            thread_pool);
+
+        timer.start();
+
+        searcher->search(writer, reader, batch_size);
 
-    std::shared_ptr<EValue> evalue_params = createEValue(database_cells, scorer);
+        if (!reader->error().empty()) {
+            fprintf(stderr, "[sword::] error: unable to read queries, %s!\n",
+                reader->error().c_str());
+            return 1;
+        }
+
+        timer.stop();
+        timer.print("database", "search and alignment");
+
+        return 0;
+    }
+
+    std::shared_ptr<Kmers> kmers = createKmers(kmer_length, threshold, scorer,
+        alphabet, seeds, max_neighbours, thread_pool);
+
+    /* with a memory limit, database parts and query batches are sized so
+     * that the search stays below it */
+    std::shared_ptr<MemoryAccountant> memory;
+    if (memory_limit > 0) {
+        memory = createMemoryAccountant(memory_limit);
+        memory->reserve(kmersMemory(kmers, thread_pool->num_threads()));
+    }
+
+    if (num_shards > 0) {
+
+        if (memory) {
+            memory->plan(max_candidates, max_alignments, false);
+        }
+
+        /* candidates and alignments of the shard are written for sword merge,
+         * all alignments which the merge can select are kept */
+        CandidateSet candidates;
+        auto database_cells = searchDatabase(candidates, database_path,
+            queries_path, kmers, max_candidates, dedup_targets,
+            mask_low_complexity, shard, num_shards, memory, thread_pool);
+
+        timer.stop();
+        timer.print("database", "search");
+        timer.reset();
+        timer.start();
+
+        ShardParameters parameters = {shard, num_shards, databaseCells(
+            database_path, database_cells), static_cast<uint32_t>(candidates.size()),
+            scorer, max_candidates, candidates_zscore, max_evalue,
+            static_cast<uint32_t>(max_alignments), algorithm, kmer_length,
+            threshold, static_cast<uint32_t>(max_neighbours), alphabet,
+            kmers->seeds(), mask_low_complexity, dedup_targets};
+
+        Indexes indexes(candidates.size()), search_orders(candidates.size());
+        for (uint32_t i = 0; i < candidates.size(); ++i) {
+            for (const auto& it: candidates[i].entries) {
+                search_orders[i].emplace_back(it.id);
+            }
+            indexes[i] = search_orders[i];
+            std::sort(indexes[i].begin(), indexes[i].end());
+        }
+
+        std::shared_ptr<EValue> evalue_params = createEValue(
+            parameters.database_cells, scorer);
+
+        ChainSet queries;
+        createChainSet(queries, queries_path, thread_pool);
+
+        ChainSet database;
+        std::vector<AlignmentSet> alignments;
+        alignDatabase(alignments, database, algorithm, database_path, queries,
+            indexes, search_orders, max_evalue, evalue_params, max_alignments,
+            scorer, memory, thread_pool);
+
+        writeShard(output_path, parameters, candidates, alignments, database);
+
+        timer.stop();
+        timer.print("database", "alignment");
+
+        if (memory) {
+            memory->print();
+        }
+
+        return 0;
+    }
+
+    /* the size of the database is known before the search if it can be
+     * counted cheaply (uncompressed files and indexes) */
+    std::shared_ptr<EValue> evalue_params;
+    auto database_cells = countResidues(database_path);
+    if (database_cells > 0) {
+        evalue_params = createEValue(database_cells, scorer);
+    }
+
+    if (pipeline && evalue_params == nullptr) {
+        fprintf(stderr, "[sword::] warning: size of the database is unknown "
+            "before the search, pipelined search is disabled!\n");
+        pipeline = false;
+    }
+
+    if (memory) {
+        memory->plan(max_candidates, max_alignments, pipeline);
+    }
+
+    auto writer = createWriter(output_path, output_format, scorer);
 
-    std::vector<AlignmentSet> alignments;
-    alignDatabase(alignments, algorithm, database_path, queries_path, indexes,
-        max_evalue, evalue_params, max_alignments, scorer, output_path,
-        output_format, thread_pool);
+    /* queries are searched in batches if they do not fit into the memory
+     * limit, the database is read again for each batch */
+    std::shared_ptr<Reader> queries_reader = createChainSetPartInitialize(
+        queries_path, thread_pool);
+
+    Timer alignment_timer;
+
+    while (true) {
+
+        ChainSet queries;
+        auto status = createChainSetBatch(queries, queries_reader,
+            memory ? memory->query_batch_chains() : 0,
+            memory ? memory->query_batch_size() : 0);
+
+        if (!queries_reader->error().empty()) {
+            fprintf(stderr, "[sword::] error: unable to read queries, %s!\n",
+                queries_reader->error().c_str());
+            return 1;
+        }
+
+        if (queries.empty()) {
+            break;
+        }
+
+        uint64_t batch_memory = 0;
+        if (memory) {
+            batch_memory = chainSetMemory(queries) + queries.size() *
+                memory->query_memory();
+            memory->reserve(batch_memory);
+        }
+
+        if (pipeline) {
+
+            /* candidates of each database part are scored while the next
+             * part is searched (evalues are needed before the search) */
+            searchAndAlignDatabase(writer, algorithm, database_path, queries,
+                kmers, max_candidates, dedup_targets, mask_low_complexity,
+                max_evalue, evalue_params, max_alignments, scorer, memory,
+                thread_pool);
+
+        } else {
+
+            Indexes indexes;
+            ChainSet database;
+            auto searched_cells = searchDatabase(indexes, database,
+                database_path, queries, kmers, max_candidates,
+                candidates_zscore, dedup_targets, mask_low_complexity, memory,
+                thread_pool);
+
+            timer.stop();
+            alignment_timer.start();
+
+            if (evalue_params == nullptr) {
+                evalue_params = createEValue(databaseCells(database_path,
+                    searched_cells), scorer);
+            }
+
+            if (!database.empty()) {
+
+                /* a database read as a single part is still in memory */
+                uint64_t database_memory = 0;
+                if (memory) {
+                    database_memory = chainSetMemory(database);
+                    memory->reserve(database_memory);
+                }
+
+                alignDatabase(writer, algorithm, queries, database, indexes,
+                    max_evalue, evalue_params, max_alignments, scorer,
+                    thread_pool);
+
+                if (memory) {
+                    memory->release(database_memory);
+                }
+            } else {
+                alignDatabase(writer, algorithm, database_path, queries,
+                    indexes, max_evalue, evalue_params, max_alignments, scorer,
+                    memory, thread_pool);
+            }
+
+            alignment_timer.stop();
+            timer.start();
+        }
+
+        if (memory) {
+            memory->release(batch_memory);
+        }
+
+        if (status == false) {
+            break;
+        }
+    }
 
     timer.stop();
-    timer.print("database", "alignment");
+    if (pipeline) {
+        timer.print("database", "search and alignment");
+    } else {
+        timer.print("database", "search");
+        alignment_timer.print("database", "alignment");
+    }
+
+    if (memory) {
+        memory->print();
+    }
 
     return 0;
 }
@@ -173,6 +560,8 @@ OutputType strToOutputType(const std::string& str) {
         return OutputType::kBm8;
     } else if (str.compare("bm9") == 0) {
         return OutputType::kBm9;
+    } else if (str.compare("bin") == 0) {
+        return OutputType::kBin;
     }
 
     assert(false && "unrecognized output format");
@@ -216,17 +605,251 @@ AlignmentType strToAlignmentType(const std::string& str) {
     assert(false && "unrecognized aignment type");
 }
 
+AlphabetType strToAlphabetType(const std::string& str) {
+
+    if (str.compare("full") == 0) {
+        return AlphabetType::kFull;
+    } else if (str.compare("murphy10") == 0) {
+        return AlphabetType::kMurphy10;
+    } else if (str.compare("seb14") == 0) {
+        return AlphabetType::kSeB14;
+    }
+
+    fprintf(stderr, "[sword::] error: unknown alphabet %s!\n", str.c_str());
+    exit(1);
+}
+
+std::vector<uint32_t> strToSeeds(const std::string& str) {
+
+    std::vector<uint32_t> seeds;
+    uint32_t seed = 0;
+    uint32_t span = 0;
+
+    for (uint32_t i = 0; i <= str.size(); ++i) {
+        if (i == str.size() || str[i] == ',') {
+            if (span == 0 || (seed & 1) == 0 || seedSpan(seed) != span) {
+                fprintf(stderr, "[sword::] error: invalid seed %s (seeds must "
+                    "begin and end with 1)!\n", str.c_str());
+                exit(1);
+            }
+            seeds.emplace_back(seed);
+            seed = 0;
+            span = 0;
+        } else {
+            if ((str[i] != '0' && str[i] != '1') || ++span > kMaxSeedSpan) {
+                fprintf(stderr, "[sword::] error: invalid seed %s (seeds are "
+                    "made of at most %u zeros and ones)!\n", str.c_str(),
+                    kMaxSeedSpan);
+                exit(1);
+            }
+            seed = (seed << 1) | (str[i] - '0');
+        }
+    }
+
+    return seeds;
+}
+
+bool isStream(const std::string& path) {
+
+    if (path.compare("-") == 0) {
+        return true;
+    }
+
+    struct stat path_stat;
+    return stat(path.c_str(), &path_stat) == 0 && S_ISFIFO(path_stat.st_mode);
+}
+
+bool strToShard(const std::string& str, uint32_t& shard, uint32_t& num_shards) {
+
+    auto slash = str.find('/');
+    if (slash == std::string::npos || slash == 0 || slash + 1 == str.size() ||
+        str.find_first_not_of("0123456789/") != std::string::npos ||
+        str.find('/', slash + 1) != std::string::npos) {
+        return false;
+    }
+
+    shard = atoi(str.c_str());
+    num_shards = atoi(str.c_str() + slash + 1);
+
+    return shard < num_shards;
+}
+
+uint64_t strToMemory(const std::string& str) {
+
+    char* unit = nullptr;
+    double value = strtod(str.c_str(), &unit);
+    if (unit == str.c_str() || value <= 0) {
+        return 0;
+    }
+
+    uint32_t shift = 0;
+    switch (*unit) {
+        case '\0':
+            break;
+        case 'k': case 'K':
+            shift = 10;
+            break;
+        case 'm': case 'M':
+            shift = 20;
+            break;
+        case 'g': case 'G':
+            shift = 30;
+            break;
+        case 't': case 'T':
+            shift = 40;
+            break;
+        default:
+            return 0;
+    }
+    if (*unit != '\0' && unit[1] != '\0') {
+        return 0;
+    }
+
+    return value * (1ULL << shift);
+}
+
+int mergeMain(int argc, char* argv[]) {
+
+    static struct option merge_options[] = {
+        {"query", required_argument, 0, 'i'},
+        {"out", required_argument, 0, 'o'},
+        {"outfmt", required_argument, 0, 'f'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    std::string queries_path;
+    std::string output_path;
+    OutputType output_format = OutputType::kBm9;
+
+    char opt;
+    while ((opt = getopt_long(argc, argv, "i:o:f:h", merge_options, nullptr)) != -1) {
+
+        switch (opt) {
+        case 'i':
+            queries_path = optarg;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'f':
+            output_format = strToOutputType(optarg);
+            break;
+        case 'h':
+            mergeHelp();
+            return 0;
+        default:
+            return 1;
+        }
+    }
+
+    if (queries_path.empty()) {
+        fprintf(stderr, "[sword::merge] error: missing input queries file!\n");
+        mergeHelp();
+        return 1;
+    }
+
+    std::vector<std::string> paths(argv + optind, argv + argc);
+    if (paths.empty()) {
+        fprintf(stderr, "[sword::merge] error: missing shard results!\n");
+        mergeHelp();
+        return 1;
+    }
+
+    mergeShards(paths, queries_path, output_path, output_format);
+
+    return 0;
+}
+
+int indexMain(int argc, char* argv[]) {
+
+    if (argc == 2 && (std::string(argv[1]) == "-h" ||
+        std::string(argv[1]) == "--help")) {
+        indexHelp();
+        return 0;
+    }
+
+    std::string command = argc > 1 ? argv[1] : "";
+    std::string index_path = argc > 2 ? argv[2] : "";
+
+    if (command == "append" && argc == 4) {
+
+        auto index = createIndex(index_path);
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool =
+            thread_pool::createThreadPool(std::thread::hardware_concurrency() / 2);
+
+        auto version = index->append(argv[3], thread_pool);
+        const auto& block = index->blocks().back();
+
+        fprintf(stderr, "[sword::index] appended %u chains (%lu residues) as "
+            "version %u\n", block.num_chains, block.num_residues, version);
+
+    } else if (command == "remove" && argc == 4) {
+
+        std::vector<std::string> ids;
+        std::ifstream ids_file(argv[3]);
+        if (!ids_file.is_open()) {
+            fprintf(stderr, "[sword::index] error: unable to open file %s!\n",
+                argv[3]);
+            return 1;
+        }
+        std::string line;
+        while (std::getline(ids_file, line)) {
+            auto begin = line.find_first_not_of(" \t\r>");
+            if (begin == std::string::npos) {
+                continue;
+            }
+            ids.emplace_back(line.substr(begin, line.find_first_of(" \t\r",
+                begin) - begin));
+        }
+
+        auto index = createIndex(index_path);
+        auto num_removed = index->remove(ids);
+
+        fprintf(stderr, "[sword::index] removed %u chains", num_removed);
+        if (num_removed != 0) {
+            fprintf(stderr, " as version %u", index->version());
+        }
+        fprintf(stderr, "\n");
+
+    } else if (command == "info" && argc == 3) {
+
+        auto index = createIndex(index_path);
+
+        printf("# version %u, %lu residues\n", index->version(), index->cells());
+        printf("# block version, chains, residues, removed chains, removed residues\n");
+        for (const auto& it: index->blocks()) {
+            printf("%u\t%u\t%lu\t%u\t%lu\n", it.version, it.num_chains,
+                it.num_residues, it.num_removed_chains, it.num_removed_residues);
+        }
+
+    } else {
+        indexHelp();
+        return 1;
+    }
+
+    return 0;
+}
+
 void help() {
     printf(
     "usage: sword -i <query db file> -j <target db file> [arguments ...]\n"
+    "       sword index <command> ... (see sword index -h)\n"
+    "       sword merge -i <query db file> <shard results> ... (see sword\n"
+    "           merge -h)\n"
+    "       sword serve -j <target db file> --socket <file> [arguments ...]\n"
     "\n"
     "arguments:\n"
     "    -i, --query <file>\n"
     "        (required)\n"
-    "        input fasta database query file\n"
+    "        input fasta database query file, if - is given queries are\n"
+    "        read from stdin (named pipes are supported as well)\n"
     "    -j, --target <file>\n"
     "        (required)\n"
-    "        input fasta database target file\n"
+    "        input fasta database target file or database index (see sword\n"
+    "        index -h), <index>@<version> searches only blocks appended\n"
+    "        after given version while evalues are computed for the whole\n"
+    "        index\n"
     "    -g, --gap-open <int>\n"
     "        default: 10\n"
     "        gap opening penalty, must be given as a positive integer \n"
@@ -254,6 +877,7 @@ void help() {
     "            bm0      - blast m0 output format\n"
     "            bm8      - blast m8 tabular output format\n"
     "            bm9      - blast m9 commented tabular output format\n"
+    "            bin      - binary records (see src/alignment_reader.hpp)\n"
     "    -v, --evalue <float>\n"
     "        default: 10.0\n"
     "        evalue threshold, alignments with higher evalue are filtered,\n"
@@ -271,20 +895,132 @@ void help() {
     "    -k, --kmer-length <int>\n"
     "        default: 3\n"
     "        length of kmers used for database search\n"
-    "        possible values: 3, 4, 5\n"
+    "        possible values: 3, 4, 5 (and 6 for reduced alphabets)\n"
     "    -c, --max-candidates <int>\n"
     "        default: 30000\n"
     "        number of target sequences (per query sequence) passed\n"
     "        to the alignment part\n"
+    "    --candidates-zscore <float>\n"
+    "        default: 0\n"
+    "        if greater than 0, targets are passed to the alignment part only\n"
+    "        if their search score lies at least given number of standard\n"
+    "        deviations above the mean search score of all targets against\n"
+    "        the query (at most max-candidates of them)\n"
     "    -T, --threshold <int>\n"
     "        default: 13\n"
     "        minimum score for two kmers to trigger a hit\n"
     "        if 0 given, only exact matching kmers are checked\n"
+    "    --max-neighbours <int>\n"
+    "        default: 0 for kmer length 3, 100 otherwise\n"
+    "        maximum number of similar kmers (the best scoring ones) a kmer\n"
+    "        triggers hits with, if 0 given all kmers which reach the\n"
+    "        threshold are used\n"
+    "    --alphabet <string>\n"
+    "        default: full\n"
+    "        alphabet in which kmers are formed for database search,\n"
+    "        must be one of the following:\n"
+    "            full     - all amino acids\n"
+    "            murphy10 - Murphy 10 letter reduced alphabet\n"
+    "            seb14    - SE-B(14) 14 letter reduced alphabet\n"
+    "        kmers of reduced alphabets are matched only exactly, alignment\n"
+    "        always uses the full alphabet\n"
+    "    --seed <string>\n"
+    "        default: contiguous seed of kmer length\n"
+    "        comma separated list of spaced seeds used for database search,\n"
+    "        e.g. 1101,1011 (1 - residue is part of the kmer, 0 - residue is\n"
+    "        ignored); all seeds must have the same number of ones which\n"
+    "        overrides kmer length, and must begin and end with 1\n"
     "    -t, --threads <int>\n"
     "        default: hardware concurrency / 2\n"
     "        number of threads used in thread pool\n"
+    "    -b, --batch-size <int>\n"
+    "        default: 0 (1000 if queries are read from stdin or a pipe)\n"
+    "        if greater than 0, the database is kept in memory and queries\n"
+    "        are searched, aligned and outputted in batches of given size\n"
+    "        as they are read\n"
+    "    --dedup-targets\n"
+    "        target sequences with identical residues are searched only\n"
+    "        once (all of them are reported), identical queries are always\n"
+    "        searched only once\n"
+    "    --mask\n"
+    "        low complexity regions of queries and targets (found with a\n"
+    "        SEG-like entropy filter) are left out of the database search,\n"
+    "        alignments are not affected\n"
+    "    --shard <int>/<int>\n"
+    "        searches only shard i of n of the target database (targets\n"
+    "        whose position modulo n is i) and writes partial results to\n"
+    "        the output file; partial results of all shards are combined\n"
+    "        with sword merge into the output of a search of the whole\n"
+    "        database (all shards have to use the same arguments)\n"
+    "    --pipeline\n"
+    "        candidates of each part of the target database are scored while\n"
+    "        the next part is searched, so that the database is read only\n"
+    "        once; targets which are replaced by better candidates of later\n"
+    "        parts are scored as well (and can be reported), cannot be used\n"
+    "        with candidates-zscore, shards or compressed target databases\n"
+    "    --memory-limit <size>\n"
+    "        default: none\n"
+    "        memory (e.g. 16G, 512M) within which database parts, query\n"
+    "        batches and candidates are sized; queries which do not fit are\n"
+    "        searched in batches (each reading the database again), the\n"
+    "        peak of accounted and resident memory is reported at the end;\n"
+    "        not applied in streaming mode, shards use a single batch\n"
+    "    --socket <file>\n"
+    "        (required for sword serve)\n"
+    "        sword serve keeps the target database, kmers and threads\n"
+    "        resident and listens on a Unix domain socket at given path;\n"
+    "        each connection sends queries in fasta format and shuts down\n"
+    "        its sending side, alignments are sent back in the output format\n"
+    "        as batches are done (e.g. nc -U -N <file> < <query db file>);\n"
+    "        up to 8 connections are searched at the same time and share\n"
+    "        the threads, a connection which sends no input or takes no\n"
+    "        output for 60 seconds is dropped\n"
     "    --version\n"
     "        prints the version number\n"
     "    -h, --help\n"
     "        prints out the help\n");
 }
+
+void indexHelp() {
+    printf(
+    "usage: sword index <command> <index file> [arguments ...]\n"
+    "\n"
+    "A database index is updated in place by appending blocks of sequences\n"
+    "and tombstones which remove sequences, each update gets a new version.\n"
+    "\n"
+    "commands:\n"
+    "    append <index file> <fasta file>\n"
+    "        appends sequences of fasta file (or of another index) as a new\n"
+    "        block, the index is created if it does not exist\n"
+    "    remove <index file> <ids file>\n"
+    "        removes sequences whose id (first word of the name) is listed\n"
+    "        in ids file (one per line) from all blocks, sequences appended\n"
+    "        afterwards are not affected\n"
+    "    info <index file>\n"
+    "        prints the version and per block statistics of the index\n");
+}
+
+void mergeHelp() {
+    printf(
+    "usage: sword merge -i <query db file> [arguments ...] <shard results> ...\n"
+    "\n"
+    "Combines partial results of all shards of a search (see --shard) into\n"
+    "the output of a search of the whole database.\n"
+    "\n"
+    "arguments:\n"
+    "    -i, --query <file>\n"
+    "        (required)\n"
+    "        input fasta database query file used by the shards\n"
+    "    -o, --out <string>\n"
+    "        default: stdout\n"
+    "        output file for the alignment\n"
+    "    -f, --outfmt <string>\n"
+    "        default: bm9\n"
+    "        out format for the output file, must be one of the following:\n"
+    "            bm0      - blast m0 output format\n"
+    "            bm8      - blast m8 tabular output format\n"
+    "            bm9      - blast m9 commented tabular output format\n"
+    "            bin      - binary records (see src/alignment_reader.hpp)\n"
+    "    -h, --help\n"
+    "        prints out the help\n");
+}
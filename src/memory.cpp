@@ -0,0 +1,133 @@
+/*!
+ * @file memory.cpp
+ *
+ * @brief MemoryAccountant class source file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <algorithm>
+
+#include "chain.hpp"
+#include "kmers.hpp"
+#include "memory.hpp"
+
+/* chains take about twice the bytes of their input once the overhead of
+ * chain objects and the search order of a part are added */
+constexpr uint64_t kChainMemoryFactor = 2;
+
+/* a candidate is stored as an entry of the search, a copy of it while
+ * entries of a part are merged and an index of the alignment */
+constexpr uint64_t kCandidateMemory = 32;
+
+/* an alignment with its runs, the target chain kept in memory for it and
+ * its formatted output */
+constexpr uint64_t kAlignmentMemory = 1024;
+
+constexpr size_t kMinDatabasePartSize = 1 << 20;
+
+[[noreturn]] static void memoryError(const char* message, double megabytes) {
+    fprintf(stderr, "[sword::Memory] error: %s %.1f MB!\n", message, megabytes);
+    exit(1);
+}
+
+static double toMegabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+std::unique_ptr<MemoryAccountant> createMemoryAccountant(uint64_t limit) {
+    return std::unique_ptr<MemoryAccountant>(new MemoryAccountant(limit));
+}
+
+size_t databasePartSize(std::shared_ptr<MemoryAccountant> memory) {
+    return memory ? memory->database_part_size() : kDatabasePartSize;
+}
+
+uint64_t chainSetMemory(const ChainSet& chains, uint32_t begin) {
+
+    uint64_t bytes = 0;
+    for (uint32_t i = begin; i < chains.size(); ++i) {
+        if (chains[i] == nullptr) {
+            continue;
+        }
+        bytes += sizeof(Chain) + chains[i]->name().capacity() +
+            chains[i]->data().capacity() + chains[i]->low_complexity().size() *
+            sizeof(Intervals::value_type);
+    }
+
+    return bytes + (chains.size() - begin) * sizeof(std::unique_ptr<Chain>);
+}
+
+uint64_t kmersMemory(std::shared_ptr<Kmers> kmers, uint32_t num_threads) {
+
+    /* substitutions and their offsets */
+    uint64_t bytes = sizeof(uint32_t) * kmers->num_kmers() *
+        (kmers->neighbourhood_size() + 1);
+
+    /* each search task builds hashes with offsets of all kmers */
+    bytes += static_cast<uint64_t>(num_threads) * sizeof(uint32_t) *
+        kmers->num_kmers() * kmers->seeds().size();
+
+    return bytes;
+}
+
+MemoryAccountant::MemoryAccountant(uint64_t limit)
+        : limit_(limit), used_(0), peak_(0),
+        database_part_size_(kDatabasePartSize), query_batch_size_(0),
+        query_batch_chains_(0), query_memory_(0) {
+}
+
+void MemoryAccountant::reserve(uint64_t bytes) {
+
+    auto used = used_ += bytes;
+
+    auto peak = peak_.load();
+    while (peak < used && !peak_.compare_exchange_weak(peak, used)) {
+    }
+}
+
+void MemoryAccountant::release(uint64_t bytes) {
+    used_ -= std::min<uint64_t>(bytes, used_);
+}
+
+void MemoryAccountant::plan(uint32_t max_candidates, uint32_t max_alignments,
+    bool pipelined) {
+
+    uint64_t used = used_;
+    if (used >= limit_) {
+        memoryError("memory limit is too small, kmers alone need", toMegabytes(used));
+    }
+
+    /* half of the rest is given to database parts, half to query batches,
+     * whose input and candidates share it equally */
+    uint64_t available = (limit_ - used) / 2;
+    uint64_t num_parts = pipelined ? 2 : 1;
+
+    database_part_size_ = available / kChainMemoryFactor / num_parts;
+    query_memory_ = max_candidates * kCandidateMemory + max_alignments *
+        kAlignmentMemory;
+    query_batch_size_ = available / 2 / kChainMemoryFactor;
+    query_batch_chains_ = std::min<uint64_t>(available / 2 / query_memory_,
+        UINT32_MAX);
+
+    if (database_part_size_ < kMinDatabasePartSize || query_batch_chains_ == 0) {
+        memoryError("memory limit is too small, a search needs at least",
+            toMegabytes(used + 2 * std::max(kMinDatabasePartSize *
+                kChainMemoryFactor * num_parts, 2 * query_memory_)));
+    }
+
+    fprintf(stderr, "[sword::Memory] database parts of %.1f MB, query batches "
+        "of %.1f MB or %u queries\n", toMegabytes(database_part_size_),
+        toMegabytes(query_batch_size_), query_batch_chains_);
+}
+
+void MemoryAccountant::print() const {
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(stderr, "[sword::Memory] peak of %.1f MB accounted, %.1f MB "
+        "resident (limit %.1f MB)\n", toMegabytes(peak_),
+        usage.ru_maxrss / 1024.0, toMegabytes(limit_));
+}
@@ -0,0 +1,122 @@
+/*!
+ * @file memory.hpp
+ *
+ * @brief MemoryAccountant class header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+class Chain;
+class Kmers;
+class MemoryAccountant;
+
+using ChainSet = std::vector<std::unique_ptr<Chain>>;
+
+/* bytes of input read into a database part without a memory limit */
+constexpr size_t kDatabasePartSize = 1000000000; /* ~1 GB */
+
+/*!
+ * @brief Accounts memory of the large structures of a search against limit
+ * (in bytes) and sizes database parts and query batches to stay below it
+ */
+std::unique_ptr<MemoryAccountant> createMemoryAccountant(uint64_t limit);
+
+/*!
+ * @brief Bytes of input read into a database part (kDatabasePartSize if
+ * memory is not set)
+ */
+size_t databasePartSize(std::shared_ptr<MemoryAccountant> memory);
+
+/*!
+ * @brief Memory used by chains[begin], ..., chains[chains.size() - 1]
+ * (released chains are skipped)
+ */
+uint64_t chainSetMemory(const ChainSet& chains, uint32_t begin = 0);
+
+/*!
+ * @brief Memory of the neighbourhoods of kmers and of the query hashes built
+ * by num_threads search tasks
+ */
+uint64_t kmersMemory(std::shared_ptr<Kmers> kmers, uint32_t num_threads);
+
+class MemoryAccountant {
+public:
+
+    ~MemoryAccountant() = default;
+
+    uint64_t limit() const {
+        return limit_;
+    }
+
+    /*!
+     * @brief Accounts bytes which are allocated, the peak of accounted bytes
+     * is kept
+     */
+    void reserve(uint64_t bytes);
+
+    void release(uint64_t bytes);
+
+    uint64_t peak() const {
+        return peak_;
+    }
+
+    /*!
+     * @brief Splits the memory which is not accounted yet between database
+     * parts and query batches of a search which keeps max_candidates
+     * candidates and max_alignments alignments per query; two database parts
+     * are in memory at once if pipelined is set
+     * @details Exits with an error if the rest is too small for a search.
+     */
+    void plan(uint32_t max_candidates, uint32_t max_alignments, bool pipelined);
+
+    size_t database_part_size() const {
+        return database_part_size_;
+    }
+
+    /*!
+     * @brief Query batches are cut at query_batch_size() bytes of input or at
+     * query_batch_chains() queries, whichever comes first
+     */
+    size_t query_batch_size() const {
+        return query_batch_size_;
+    }
+
+    uint32_t query_batch_chains() const {
+        return query_batch_chains_;
+    }
+
+    /*!
+     * @brief Memory which candidates and alignments of a query take at most
+     */
+    uint64_t query_memory() const {
+        return query_memory_;
+    }
+
+    /*!
+     * @brief Prints the peak of accounted memory and the peak resident set
+     * size of the process against the limit
+     */
+    void print() const;
+
+    friend std::unique_ptr<MemoryAccountant> createMemoryAccountant(uint64_t limit);
+
+private:
+
+    MemoryAccountant(uint64_t limit);
+    MemoryAccountant(const MemoryAccountant&) = delete;
+    const MemoryAccountant& operator=(const MemoryAccountant&) = delete;
+
+    uint64_t limit_;
+    std::atomic<uint64_t> used_;
+    std::atomic<uint64_t> peak_;
+    size_t database_part_size_;
+    size_t query_batch_size_;
+    uint32_t query_batch_chains_;
+    uint64_t query_memory_;
+};
@@ -5,90 +5,186 @@
  */
 
 #include <assert.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "chain.hpp"
+#include "input_stream.hpp"
+#include "index.hpp"
 #include "reader.hpp"
 
 constexpr uint32_t kBufferSize = 1024 * 1024;
 constexpr uint32_t kArraySize = 65000;
 
-std::unique_ptr<Reader> createReader(const std::string& path) {
+std::unique_ptr<Reader> createReader(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
 
-    auto input_file = fopen(path.c_str(), "r");
-    assert(input_file);
+    std::string index_path;
+    uint32_t since = 0;
 
-    return std::unique_ptr<Reader>(new Reader(input_file));
+    auto input_stream = parseIndexPath(path, index_path, since) ?
+        createIndex(index_path)->stream(since) :
+        createInputStream(path, thread_pool);
+    assert(input_stream);
+
+    return std::unique_ptr<Reader>(new Reader(std::move(input_stream)));
 }
 
-Reader::Reader(FILE* input_file)
-        : input_file_(input_file, fclose), buffer_(kBufferSize, '0'),
-        num_chains_read_(0) {
+std::unique_ptr<Reader> createReader(int file_descriptor,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    return std::unique_ptr<Reader>(new Reader(createInputStream(file_descriptor,
+        thread_pool)));
 }
 
-bool Reader::read_chains(ChainSet& dst, size_t max_bytes) {
+uint64_t countResidues(const std::string& path) {
 
-    /* Code taken from SW# (author: Matija Korpar) */
+    std::string index_path;
+    uint32_t since = 0;
+    if (parseIndexPath(path, index_path, since)) {
+        return createIndex(index_path)->cells();
+    }
 
-    bool status = false;
-    size_t bytes_read = 0;
-    size_t bytes_over = 0;
+    struct stat path_stat;
+    if (stat(path.c_str(), &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+        return 0;
+    }
 
-    auto input_file = input_file_.get();
+    auto input_stream = createInputStream(path);
+    if (input_stream->compression() != CompressionType::kNone) {
+        return 0;
+    }
 
+    /* follows read_chains: a name lasts until the end of its line, residues
+     * are letters until the next '>' */
+    std::vector<char> buffer(kBufferSize);
     bool is_name = true;
-    bool is_end = feof(input_file);
+    uint64_t num_residues = 0;
+
+    size_t length;
+    while ((length = input_stream->read(buffer.data(), kBufferSize)) > 0) {
+
+        const char* begin = buffer.data();
+        const char* end = begin + length;
+
+        while (begin < end) {
+            if (is_name) {
+                auto newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+                if (newline == nullptr) {
+                    break;
+                }
+                is_name = false;
+                begin = newline + 1;
+            } else {
+                for (; begin < end; ++begin) {
+                    auto c = *begin;
+                    if (c == '>') {
+                        is_name = true;
+                        break;
+                    }
+                    num_residues += static_cast<uint8_t>((c | 0x20) - 'a') < 26;
+                }
+            }
+        }
+    }
+
+    return num_residues;
+}
+
+Reader::Reader(std::unique_ptr<InputStream> input_stream)
+        : input_stream_(std::move(input_stream)), buffer_(kBufferSize, '0'),
+        buffer_begin_(0), buffer_end_(0), is_name_(true), name_(kArraySize),
+        name_length_(0), data_(), num_chains_read_(0), error_() {
+}
+
+Reader::~Reader() {
+}
 
-    char name[kArraySize];
-    uint32_t name_length = 0;
+bool Reader::read_chains(ChainSet& dst, size_t max_bytes, uint32_t max_chains) {
 
-    char data[kArraySize];
-    uint32_t data_length = 0;
+    /* Code taken from SW# (author: Matija Korpar) */
 
-    while (!is_end) {
+    /* The input is consumed only once (it can be a pipe or a decompressor),
+     * therefore a chain which is not complete when max_bytes is reached stays
+     * in name_/data_ and is finished by the next call. */
 
-        uint32_t read = fread(buffer_.data(), sizeof(char), kBufferSize, input_file);
-        is_end = feof(input_file);
+    size_t bytes_read = 0;
+    uint32_t chains_read = 0;
 
-        bytes_read += read;
+    if (!error_.empty()) {
+        return false;
+    }
 
-        if (max_bytes != 0 && bytes_read > max_bytes) {
-            fseek(input_file, -(bytes_over + read), SEEK_CUR);
-            status = true;
-            break;
+    while (true) {
+
+        if (buffer_begin_ == buffer_end_) {
+            buffer_begin_ = 0;
+            buffer_end_ = input_stream_->read(buffer_.data(), kBufferSize);
+            if (buffer_end_ == 0) {
+                if (!input_stream_->error().empty()) {
+                    error_ = input_stream_->error();
+                    return false;
+                }
+                break;
+            }
         }
 
-        for (uint32_t i = 0; i < read; ++i) {
+        for (; buffer_begin_ < buffer_end_; ++buffer_begin_, ++bytes_read) {
 
-            auto c = buffer_[i];
+            auto c = buffer_[buffer_begin_];
 
-            if (!is_name && (c == '>' || (is_end && i == read - 1))) {
+            if (!is_name_ && c == '>') {
 
-                bytes_over = 0;
-                is_name = true;
+                if (!add_chain(dst)) {
+                    return false;
+                }
 
-                dst.emplace_back(createChain(num_chains_read_++, name, name_length,
-                    data, data_length));
+                ++chains_read;
 
-                name_length = data_length = 0;
+                if ((max_bytes != 0 && bytes_read >= max_bytes) ||
+                    (max_chains != 0 && chains_read == max_chains)) {
+                    return true;
+                }
             }
 
-            if (is_name) {
+            if (is_name_) {
                 if (c == '\n') {
-                    is_name = false;
-                } else if (name_length == kArraySize)  {
+                    is_name_ = false;
+                } else if (name_length_ == kArraySize)  {
                     continue;
-                } else if (!(name_length == 0 && (c == '>' || isspace(c)))) {
+                } else if (!(name_length_ == 0 && (c == '>' || isspace(c)))) {
                     if (c != '\r') {
-                        name[name_length++] = c;
+                        name_[name_length_++] = c;
                     }
                 }
             } else {
-                data[data_length++] = c;
+                data_.push_back(c);
             }
-
-            bytes_over++;
         }
     }
 
-    return status;
+    if (!is_name_ && !data_.empty()) {
+        add_chain(dst);
+    }
+
+    return false;
+}
+
+bool Reader::add_chain(ChainSet& dst) {
+
+    auto chain = createChain(num_chains_read_, name_.data(), name_length_,
+        data_.data(), data_.size());
+    if (chain == nullptr) {
+        error_ = "record " + std::to_string(num_chains_read_) + " has no name or "
+            "no residues";
+        return false;
+    }
+    dst.emplace_back(std::move(chain));
+    ++num_chains_read_;
+
+    is_name_ = true;
+    name_length_ = 0;
+    data_.clear();
+
+    return true;
 }
@@ -7,33 +7,99 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <memory>
 #include <vector>
 #include <string>
 
+namespace thread_pool {
+    class ThreadPool;
+}
+
 class Chain;
+class InputStream;
 class Reader;
 
 using ChainSet = std::vector<std::unique_ptr<Chain>>;
 
-std::unique_ptr<Reader> createReader(const std::string& path);
+/*!
+ * @brief Creates a FASTA reader, gzip and zstd compressed files are
+ * decompressed on the fly (see createInputStream); chains of a database index
+ * are read as if they were a FASTA file (see parseIndexPath)
+ */
+std::unique_ptr<Reader> createReader(const std::string& path,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+/*!
+ * @brief Creates a FASTA reader of an open file descriptor (e.g. a socket),
+ * which is closed with the reader
+ */
+std::unique_ptr<Reader> createReader(int file_descriptor,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+/*!
+ * @brief Number of residues in path found without creating chains (the number
+ * of residues which were not removed for a database index), 0 if this is not
+ * possible (compressed input, pipes)
+ */
+uint64_t countResidues(const std::string& path);
 
 class Reader {
 public:
 
-    ~Reader() = default;
+    ~Reader();
+
+    /*!
+     * @brief Reads chains into dst until at least max_bytes of (decompressed)
+     * input are consumed, max_chains chains are read or the input ends (0
+     * disables the respective limit)
+     * @details Returns true if there is more input to be read. Input which
+     * can not be read (see InputStream::error) or a record without a name or
+     * residues ends reading, chains before it are still added to dst.
+     */
+    bool read_chains(ChainSet& dst, size_t max_bytes, uint32_t max_chains = 0);
+
+    /*!
+     * @brief Description of the problem which ended reading, empty if the
+     * whole input was read
+     */
+    const std::string& error() const {
+        return error_;
+    }
+
+    /*!
+     * @brief Chains read after this call are numbered from 0 again
+     */
+    void reset_chain_ids() {
+        num_chains_read_ = 0;
+    }
 
-    bool read_chains(ChainSet& dst, size_t max_bytes);
+	friend std::unique_ptr<Reader> createReader(const std::string& path,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
 
-	friend std::unique_ptr<Reader> createReader(const std::string& path);
+	friend std::unique_ptr<Reader> createReader(int file_descriptor,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
 
 private:
 
-	Reader(FILE* input_file);
+	Reader(std::unique_ptr<InputStream> input_stream);
 	Reader(const Reader&) = delete;
 	const Reader& operator=(const Reader&) = delete;
 
-    std::unique_ptr<FILE, int (*)(FILE*)> input_file_;
+    bool add_chain(ChainSet& dst);
+
+    std::unique_ptr<InputStream> input_stream_;
+
     std::vector<char> buffer_;
+    uint32_t buffer_begin_;
+    uint32_t buffer_end_;
+
+    /* state of the chain which is currently parsed, kept between calls */
+    bool is_name_;
+    std::vector<char> name_;
+    uint32_t name_length_;
+    std::vector<char> data_;
+
     uint32_t num_chains_read_;
+    std::string error_;
 };
@@ -0,0 +1,137 @@
+/*!
+ * @file searcher.cpp
+ *
+ * @brief Searcher class source file
+ */
+
+#include <assert.h>
+
+#include "thread_pool/thread_pool.hpp"
+
+#include "chain.hpp"
+#include "reader.hpp"
+#include "writer.hpp"
+#include "database.hpp"
+#include "index.hpp"
+#include "evalue.hpp"
+#include "database_search.hpp"
+#include "searcher.hpp"
+
+std::unique_ptr<Searcher> createSearcher(const std::string& database_path,
+    const SearchOptions& options_, std::string& error,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    if (thread_pool == nullptr) {
+        thread_pool = thread_pool::createThreadPool(
+            std::thread::hardware_concurrency() / 2);
+    }
+
+    auto options = options_;
+    if (!options.seeds.empty()) {
+        options.kmer_length = seedWeight(options.seeds.front());
+    }
+    if (options.max_neighbours < 0) {
+        options.max_neighbours = defaultMaxNeighbours(options.kmer_length);
+    }
+
+    error = checkKmers(options.kmer_length, options.alphabet, options.seeds);
+    if (!error.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Reader> reader = createReader(database_path, thread_pool);
+    std::shared_ptr<Database> database = createDatabase(reader,
+        options.dedup_targets, options.mask_low_complexity, thread_pool);
+    if (database == nullptr) {
+        error = "unable to read database, " + reader->error();
+        return nullptr;
+    }
+
+    std::shared_ptr<ScoreMatrix> scorer = createScoreMatrix(options.matrix,
+        options.gap_open, options.gap_extend);
+
+    std::shared_ptr<Kmers> kmers = createKmers(options.kmer_length,
+        options.threshold, scorer, options.alphabet, options.seeds,
+        options.max_neighbours, thread_pool);
+
+    std::shared_ptr<EValue> evalue_params = createEValue(databaseCells(
+        database_path, database->cells()), scorer);
+
+    return std::unique_ptr<Searcher>(new Searcher(options, database, kmers,
+        evalue_params, scorer, thread_pool));
+}
+
+Searcher::Searcher(const SearchOptions& options, std::shared_ptr<Database> database,
+    std::shared_ptr<Kmers> kmers, std::shared_ptr<EValue> evalue_params,
+    std::shared_ptr<ScoreMatrix> scorer,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool)
+        : options_(options), database_(database), kmers_(kmers),
+        evalue_params_(evalue_params), scorer_(scorer), thread_pool_(thread_pool) {
+}
+
+const ChainSet& Searcher::database() const {
+    return database_->chains();
+}
+
+void Searcher::search(std::vector<AlignmentSet>& dst, ChainSet& queries) const {
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        assert(queries[i]->id() == i && "queries need ids 0, ..., n - 1");
+    }
+
+    if (options_.mask_low_complexity) {
+        maskLowComplexity(queries, 0, thread_pool_);
+    }
+
+    Indexes indexes;
+    searchDatabase(indexes, queries, database_, options_.max_candidates,
+        options_.candidates_zscore, kmers_, thread_pool_);
+
+    alignDatabase(dst, options_.algorithm, queries, database_->chains(),
+        indexes, options_.max_evalue, evalue_params_, options_.max_alignments,
+        scorer_, thread_pool_);
+
+    /* duplicate queries are searched once and get copies of the alignments
+     * of their first occurrence */
+    std::vector<uint32_t> duplicates;
+    if (findDuplicateChains(duplicates, queries) == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        if (duplicates[i] == i) {
+            continue;
+        }
+        for (const auto& it: dst[duplicates[i]]) {
+            dst[i].emplace_back(copyAlignment(it, i));
+        }
+    }
+}
+
+void Searcher::search(const std::unique_ptr<Writer>& writer,
+    std::shared_ptr<Reader> reader, uint32_t batch_size) const {
+
+    while (true) {
+
+        ChainSet queries;
+        auto status = createChainSetBatch(queries, reader, batch_size);
+
+        if (!queries.empty()) {
+
+            if (options_.mask_low_complexity) {
+                maskLowComplexity(queries, 0, thread_pool_);
+            }
+
+            Indexes indexes;
+            searchDatabase(indexes, queries, database_, options_.max_candidates,
+                options_.candidates_zscore, kmers_, thread_pool_);
+
+            alignDatabase(writer, options_.algorithm, queries,
+                database_->chains(), indexes, options_.max_evalue,
+                evalue_params_, options_.max_alignments, scorer_, thread_pool_);
+        }
+
+        if (status == false) {
+            break;
+        }
+    }
+}
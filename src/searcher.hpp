@@ -0,0 +1,130 @@
+/*!
+ * @file searcher.hpp
+ *
+ * @brief Searcher class header file
+ *
+ * @details Entry point of library sword for programs which search queries
+ * kept in memory against the same database many times: the database, kmers
+ * and threads are created once by createSearcher and every search returns
+ * alignments without writing or reading files. There is no global state, a
+ * program can hold several searchers.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "score_matrix.hpp"
+#include "kmers.hpp"
+#include "database_alignment.hpp"
+
+namespace thread_pool {
+    class ThreadPool;
+}
+
+class Chain;
+class Reader;
+class Writer;
+class Database;
+class EValue;
+class Searcher;
+
+using ChainSet = std::vector<std::unique_ptr<Chain>>;
+using AlignmentSet = std::vector<std::unique_ptr<Alignment>>;
+
+/*!
+ * @brief Arguments of a search, defaults are those of the command line (see
+ * sword -h)
+ */
+struct SearchOptions {
+    ScoreMatrixType matrix = ScoreMatrixType::kBlosum62;
+    int32_t gap_open = 10;
+    int32_t gap_extend = 1;
+    AlignmentType algorithm = AlignmentType::kSW;
+    double max_evalue = 10;
+    uint32_t max_alignments = 10;
+    uint32_t kmer_length = 3;
+    uint32_t max_candidates = 30000;
+    double candidates_zscore = 0;
+    uint32_t threshold = 13;
+    /* -1 for defaultMaxNeighbours(kmer_length) */
+    int32_t max_neighbours = -1;
+    AlphabetType alphabet = AlphabetType::kFull;
+    /* spaced seeds override kmer_length */
+    std::vector<uint32_t> seeds;
+    bool dedup_targets = false;
+    bool mask_low_complexity = false;
+};
+
+/*!
+ * @brief Loads the database at database_path (FASTA file, possibly
+ * compressed, or database index) and creates kmers of options; a thread pool
+ * with hardware concurrency / 2 threads is created if none is given
+ * @details Returns nullptr and sets error if the kmer options are invalid or
+ * the database can not be opened or read (e.g. corrupted compression).
+ */
+std::unique_ptr<Searcher> createSearcher(const std::string& database_path,
+    const SearchOptions& options, std::string& error,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+class Searcher {
+public:
+
+    ~Searcher() = default;
+
+    /*!
+     * @brief Searches and aligns in-memory queries (with ids 0, ...,
+     * queries.size() - 1, see createChain), dst[i] contains alignments of
+     * queries[i] sorted by evalue; target ids of alignments are positions in
+     * database()
+     * @details Low complexity regions of queries are found if
+     * mask_low_complexity is set. Identical queries are searched only once.
+     */
+    void search(std::vector<AlignmentSet>& dst, ChainSet& queries) const;
+
+    /*!
+     * @brief Searches queries of reader in batches of batch_size queries as
+     * they arrive and writes alignments of each query with writer as soon as
+     * it is done (streaming mode and sword serve)
+     * @details Input which can not be read ends the search after the queries
+     * before it are written, Reader::error tells why.
+     */
+    void search(const std::unique_ptr<Writer>& writer, std::shared_ptr<Reader> reader,
+        uint32_t batch_size) const;
+
+    /*!
+     * @brief Chains of the database in input order (database()[i]->id() == i)
+     */
+    const ChainSet& database() const;
+
+    std::shared_ptr<ScoreMatrix> scorer() const {
+        return scorer_;
+    }
+
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool() const {
+        return thread_pool_;
+    }
+
+    friend std::unique_ptr<Searcher> createSearcher(const std::string& database_path,
+        const SearchOptions& options, std::string& error,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+
+private:
+
+    Searcher(const SearchOptions& options, std::shared_ptr<Database> database,
+        std::shared_ptr<Kmers> kmers, std::shared_ptr<EValue> evalue_params,
+        std::shared_ptr<ScoreMatrix> scorer,
+        std::shared_ptr<thread_pool::ThreadPool> thread_pool);
+    Searcher(const Searcher&) = delete;
+    const Searcher& operator=(const Searcher&) = delete;
+
+    SearchOptions options_;
+    std::shared_ptr<Database> database_;
+    std::shared_ptr<Kmers> kmers_;
+    std::shared_ptr<EValue> evalue_params_;
+    std::shared_ptr<ScoreMatrix> scorer_;
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool_;
+};
@@ -0,0 +1,166 @@
+/*!
+ * @file server.cpp
+ *
+ * @brief Search of query streams against a resident database source file
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "thread_pool/thread_pool.hpp"
+
+#include "reader.hpp"
+#include "writer.hpp"
+#include "searcher.hpp"
+#include "server.hpp"
+
+constexpr int kMaxPendingConnections = 16;
+constexpr uint32_t kMaxConnections = 8;
+constexpr int kConnectionTimeout = 60; // seconds
+
+[[noreturn]] static void serverError(const char* message, const std::string& detail) {
+    fprintf(stderr, "[sword::Server] error: %s %s!\n", message, detail.c_str());
+    exit(1);
+}
+
+static void serveConnection(int connection, const Searcher& searcher,
+    OutputType output_format, uint32_t batch_size) {
+
+    /* the reader and the writer close their descriptors, the last one
+     * is used to report an error after the output is flushed */
+    auto input = dup(connection);
+    auto output = dup(connection);
+    if (input < 0 || output < 0) {
+        fprintf(stderr, "[sword::Server] warning: dropping a connection, "
+            "%s\n", strerror(errno));
+        if (input >= 0) {
+            close(input);
+        }
+        if (output >= 0) {
+            close(output);
+        }
+        close(connection);
+        return;
+    }
+
+    std::string error;
+    {
+        std::shared_ptr<Reader> reader = createReader(input,
+            searcher.thread_pool());
+        auto writer = createWriter(output, output_format,
+            searcher.scorer());
+
+        searcher.search(writer, reader, batch_size);
+        error = reader->error();
+    }
+
+    if (!error.empty()) {
+        fprintf(stderr, "[sword::Server] warning: dropping a connection, "
+            "%s\n", error.c_str());
+        auto message = "[sword::Server] error: " + error + "!\n";
+        if (write(connection, message.data(), message.size()) < 0) {
+            /* the client is gone already */
+        }
+
+        /* closing with unread input would reset the connection before the
+         * client receives the message */
+        shutdown(connection, SHUT_WR);
+        char buffer[4096];
+        while (read(connection, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+    close(connection);
+}
+
+void serveDatabase(const std::string& socket_path, const Searcher& searcher,
+    OutputType output_format, uint32_t batch_size) {
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        serverError("socket path is too long", socket_path);
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+    struct stat path_stat;
+    if (stat(socket_path.c_str(), &path_stat) == 0) {
+        if (!S_ISSOCK(path_stat.st_mode)) {
+            serverError("not a socket", socket_path);
+        }
+        unlink(socket_path.c_str());
+    }
+
+    auto server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        serverError("unable to create socket", strerror(errno));
+    }
+    if (bind(server, reinterpret_cast<struct sockaddr*>(&address),
+        sizeof(address)) != 0) {
+        serverError("unable to bind socket", socket_path);
+    }
+    if (listen(server, kMaxPendingConnections) != 0) {
+        serverError("unable to listen on", socket_path);
+    }
+
+    /* a client which disconnects early must not stop the server */
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "[sword::Server] listening on %s\n", socket_path.c_str());
+
+    /* connections are served on their own threads and share the threads of
+     * the searcher, the resident database is only read */
+    std::mutex mutex;
+    std::condition_variable connection_done;
+    uint32_t num_connections = 0;
+
+    while (true) {
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            connection_done.wait(lock, [&]() {
+                return num_connections < kMaxConnections;
+            });
+        }
+
+        auto connection = accept(server, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            serverError("unable to accept connection", strerror(errno));
+        }
+
+        /* a client which stops sending queries or reading alignments must
+         * not keep its connection forever */
+        struct timeval timeout;
+        timeout.tv_sec = kConnectionTimeout;
+        timeout.tv_usec = 0;
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+            sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+            sizeof(timeout));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++num_connections;
+        }
+        std::thread([&, connection]() {
+            serveConnection(connection, searcher, output_format, batch_size);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            --num_connections;
+            connection_done.notify_one();
+        }).detach();
+    }
+}
@@ -0,0 +1,32 @@
+/*!
+ * @file server.hpp
+ *
+ * @brief Search of query streams against a resident database header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+
+class Searcher;
+enum class OutputType;
+
+/*!
+ * @brief Listens on a Unix domain socket at socket_path and searches queries
+ * of each connection (see Searcher::search) until the process is stopped
+ * @details A client sends queries in FASTA format (possibly compressed) and
+ * shuts down its sending side, alignments are sent back in output_format and
+ * the connection is closed once all queries are done. Input which can not be
+ * read (corrupted compression, records without residues) ends the connection
+ * with the alignments of the queries before it followed by a line
+ * "[sword::Server] error: <message>!", the server keeps accepting
+ * connections. Up to 8 connections are served at the same time and share the
+ * threads of the searcher, further connections wait to be accepted. A
+ * connection which sends no input or takes no output for 60 seconds is
+ * dropped. A stale socket file at socket_path is replaced.
+ */
+void serveDatabase(const std::string& socket_path, const Searcher& searcher,
+    OutputType output_format, uint32_t batch_size);
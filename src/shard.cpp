@@ -0,0 +1,372 @@
+/*!
+ * @file shard.cpp
+ *
+ * @brief Partial results of database shards source file
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "thread_pool/thread_pool.hpp"
+
+#include "chain.hpp"
+#include "score_matrix.hpp"
+#include "writer.hpp"
+#include "database_search.hpp"
+#include "database_alignment.hpp"
+#include "alignment_reader.hpp"
+#include "shard.hpp"
+
+/* All values are stored in native byte order:
+ *     header:  magic (4 bytes), format (uint32), shard (uint32), num_shards
+ *         (uint32), database_cells (uint64), num_queries (uint32), matrix
+ *         (uint32), gap_open (int32), gap_extend (int32), max_candidates
+ *         (uint32), candidates_zscore (double), max_evalue (double),
+ *         max_alignments (uint32), algorithm (uint32), kmer_length (uint32),
+ *         threshold (uint32), max_neighbours (uint32), alphabet (uint32),
+ *         seeds (array of uint32), mask_low_complexity (uint8),
+ *         dedup_targets (uint8)
+ *     targets:  num_targets (uint32), targets as id (uint32), name, data
+ *     queries:  histogram, candidates and alignments of each query, with
+ *         operations of alignments as runs (see encodeAlignmentRuns)
+ * where strings and arrays are preceded by their length (uint32). */
+
+constexpr char kShardMagic[] = {'S', 'W', 'S', 'H'};
+constexpr uint32_t kShardFormat = 3;
+
+[[noreturn]] static void shardError(const char* message, const std::string& detail) {
+    fprintf(stderr, "[sword::Shard] error: %s %s!\n", message, detail.c_str());
+    exit(1);
+}
+
+/* ************************************************************************** */
+/* ShardFile - reads and writes values of a partial result file */
+
+class ShardFile {
+public:
+
+    ShardFile(const std::string& path, const char* mode)
+            : path_(path), file_(fopen(path.c_str(), mode)) {
+
+        if (file_ == nullptr) {
+            shardError("unable to open file", path);
+        }
+    }
+
+    ~ShardFile() {
+        if (fclose(file_) != 0) {
+            shardError("unable to write to", path_);
+        }
+    }
+
+    template<typename T>
+    void write(const T& value) {
+        write(&value, sizeof(T));
+    }
+
+    void write(const void* src, size_t size) {
+        if (size != 0 && fwrite(src, 1, size, file_) != size) {
+            shardError("unable to write to", path_);
+        }
+    }
+
+    void write(const std::string& src) {
+        write<uint32_t>(src.size());
+        write(src.data(), src.size());
+    }
+
+    template<typename T>
+    T read() {
+        T value;
+        read(&value, sizeof(T));
+        return value;
+    }
+
+    void read(void* dst, size_t size) {
+        if (size != 0 && fread(dst, 1, size, file_) != size) {
+            shardError("unable to read", path_);
+        }
+    }
+
+    void read(std::string& dst) {
+        dst.resize(read<uint32_t>());
+        read(&dst[0], dst.size());
+    }
+
+    const std::string& path() const {
+        return path_;
+    }
+
+private:
+
+    ShardFile(const ShardFile&) = delete;
+    const ShardFile& operator=(const ShardFile&) = delete;
+
+    std::string path_;
+    FILE* file_;
+};
+
+/* ************************************************************************** */
+
+void writeShard(const std::string& path, const ShardParameters& parameters,
+    const CandidateSet& candidates, const std::vector<AlignmentSet>& alignments,
+    const ChainSet& database) {
+
+    ShardFile file(path, "wb");
+
+    file.write(kShardMagic, sizeof(kShardMagic));
+    file.write(kShardFormat);
+    file.write(parameters.shard);
+    file.write(parameters.num_shards);
+    file.write(parameters.database_cells);
+    file.write(parameters.num_queries);
+    file.write<uint32_t>(static_cast<uint32_t>(parameters.scorer->type()));
+    file.write<int32_t>(parameters.scorer->gap_open());
+    file.write<int32_t>(parameters.scorer->gap_extend());
+    file.write(parameters.max_candidates);
+    file.write(parameters.candidates_zscore);
+    file.write(parameters.max_evalue);
+    file.write(parameters.max_alignments);
+    file.write<uint32_t>(static_cast<uint32_t>(parameters.algorithm));
+    file.write(parameters.kmer_length);
+    file.write(parameters.threshold);
+    file.write(parameters.max_neighbours);
+    file.write<uint32_t>(static_cast<uint32_t>(parameters.alphabet));
+    file.write<uint32_t>(parameters.seeds.size());
+    file.write(parameters.seeds.data(), parameters.seeds.size() * sizeof(uint32_t));
+    file.write<uint8_t>(parameters.mask_low_complexity);
+    file.write<uint8_t>(parameters.dedup_targets);
+
+    std::vector<uint32_t> target_ids;
+    for (const auto& it: alignments) {
+        for (const auto& alignment: it) {
+            target_ids.emplace_back(alignment->target_id());
+        }
+    }
+    std::sort(target_ids.begin(), target_ids.end());
+    target_ids.erase(std::unique(target_ids.begin(), target_ids.end()),
+        target_ids.end());
+
+    std::string data;
+
+    file.write<uint32_t>(target_ids.size());
+    for (const auto& it: target_ids) {
+        const auto& target = database[it];
+        data.resize(target->length());
+        for (uint32_t i = 0; i < target->length(); ++i) {
+            data[i] = target->data()[i] + 'A';
+        }
+        file.write(it);
+        file.write(target->name());
+        file.write(data);
+    }
+
+    for (uint32_t i = 0; i < parameters.num_queries; ++i) {
+
+        file.write<uint32_t>(candidates[i].histogram.size());
+        file.write(candidates[i].histogram.data(), candidates[i].histogram.size() *
+            sizeof(uint32_t));
+
+        file.write<uint32_t>(candidates[i].entries.size());
+        for (const auto& it: candidates[i].entries) {
+            file.write(it.id);
+            file.write(it.score);
+            file.write(it.length);
+        }
+
+        file.write<uint32_t>(alignments[i].size());
+        for (const auto& it: alignments[i]) {
+            file.write(it->score());
+            file.write(it->evalue());
+            file.write(it->target_id());
+            file.write(it->query_begin());
+            file.write(it->query_end());
+            file.write(it->target_begin());
+            file.write(it->target_end());
+            file.write(it->runs());
+        }
+    }
+}
+
+static void readShardParameters(ShardParameters& dst, ShardFile& file) {
+
+    char magic[sizeof(kShardMagic)];
+    file.read(magic, sizeof(magic));
+    if (memcmp(magic, kShardMagic, sizeof(magic)) != 0) {
+        shardError("not a sword shard result", file.path());
+    }
+    if (file.read<uint32_t>() != kShardFormat) {
+        shardError("unsupported format of shard result", file.path());
+    }
+
+    dst.shard = file.read<uint32_t>();
+    dst.num_shards = file.read<uint32_t>();
+    dst.database_cells = file.read<uint64_t>();
+    dst.num_queries = file.read<uint32_t>();
+    auto type = static_cast<ScoreMatrixType>(file.read<uint32_t>());
+    auto gap_open = file.read<int32_t>();
+    auto gap_extend = file.read<int32_t>();
+    dst.scorer = createScoreMatrix(type, gap_open, gap_extend);
+    dst.max_candidates = file.read<uint32_t>();
+    dst.candidates_zscore = file.read<double>();
+    dst.max_evalue = file.read<double>();
+    dst.max_alignments = file.read<uint32_t>();
+    dst.algorithm = static_cast<AlignmentType>(file.read<uint32_t>());
+    dst.kmer_length = file.read<uint32_t>();
+    dst.threshold = file.read<uint32_t>();
+    dst.max_neighbours = file.read<uint32_t>();
+    dst.alphabet = static_cast<AlphabetType>(file.read<uint32_t>());
+    dst.seeds.resize(file.read<uint32_t>());
+    file.read(dst.seeds.data(), dst.seeds.size() * sizeof(uint32_t));
+    dst.mask_low_complexity = file.read<uint8_t>();
+    dst.dedup_targets = file.read<uint8_t>();
+}
+
+static bool operator!=(const ShardParameters& lhs, const ShardParameters& rhs) {
+    return lhs.num_shards != rhs.num_shards ||
+        lhs.database_cells != rhs.database_cells ||
+        lhs.num_queries != rhs.num_queries ||
+        lhs.scorer->type() != rhs.scorer->type() ||
+        lhs.scorer->gap_open() != rhs.scorer->gap_open() ||
+        lhs.scorer->gap_extend() != rhs.scorer->gap_extend() ||
+        lhs.max_candidates != rhs.max_candidates ||
+        lhs.candidates_zscore != rhs.candidates_zscore ||
+        lhs.max_evalue != rhs.max_evalue ||
+        lhs.max_alignments != rhs.max_alignments ||
+        lhs.algorithm != rhs.algorithm ||
+        lhs.kmer_length != rhs.kmer_length ||
+        lhs.threshold != rhs.threshold ||
+        lhs.max_neighbours != rhs.max_neighbours ||
+        lhs.alphabet != rhs.alphabet ||
+        lhs.seeds != rhs.seeds ||
+        lhs.mask_low_complexity != rhs.mask_low_complexity ||
+        lhs.dedup_targets != rhs.dedup_targets;
+}
+
+void mergeShards(const std::vector<std::string>& paths,
+    const std::string& queries_path, const std::string& output_path,
+    OutputType output_format, std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    if (paths.empty()) {
+        shardError("no shard results given", "");
+    }
+
+    std::vector<std::unique_ptr<ShardFile>> files;
+    std::vector<ShardParameters> parameters(paths.size());
+    std::vector<bool> is_merged;
+
+    for (uint32_t i = 0; i < paths.size(); ++i) {
+        files.emplace_back(new ShardFile(paths[i], "rb"));
+        readShardParameters(parameters[i], *files[i]);
+
+        if (parameters[i] != parameters[0]) {
+            shardError("parameters of the search differ in", paths[i]);
+        }
+        if (i == 0) {
+            is_merged.resize(parameters[0].num_shards, false);
+        }
+        if (parameters[i].shard >= is_merged.size() || is_merged[parameters[i].shard]) {
+            shardError("duplicate shard in", paths[i]);
+        }
+        is_merged[parameters[i].shard] = true;
+    }
+    if (paths.size() != parameters[0].num_shards) {
+        shardError("missing results of some shards of", paths[0]);
+    }
+
+    ChainSet queries;
+    createChainSet(queries, queries_path, thread_pool);
+
+    if (queries.size() != parameters[0].num_queries) {
+        shardError("shard results were not created with queries", queries_path);
+    }
+
+    /* targets of alignments are placed at their ids */
+    ChainSet database;
+    std::string name, data;
+
+    for (const auto& file: files) {
+        auto num_targets = file->read<uint32_t>();
+        for (uint32_t i = 0; i < num_targets; ++i) {
+            auto id = file->read<uint32_t>();
+            file->read(name);
+            file->read(data);
+            if (database.size() <= id) {
+                database.resize(id + 1);
+            }
+            database[id] = createChain(id, &name[0], name.size(), &data[0],
+                data.size());
+            if (database[id] == nullptr) {
+                shardError("invalid target in", file->path());
+            }
+        }
+    }
+
+    std::vector<AlignmentSet> alignments(queries.size());
+    std::vector<QueryCandidates> candidates(files.size());
+    std::vector<uint32_t> indexes;
+    std::vector<uint32_t> runs;
+
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+
+        for (uint32_t j = 0; j < files.size(); ++j) {
+
+            auto& file = *files[j];
+
+            candidates[j].histogram.resize(file.read<uint32_t>());
+            file.read(candidates[j].histogram.data(), candidates[j].histogram.size() *
+                sizeof(uint32_t));
+
+            candidates[j].entries.resize(file.read<uint32_t>());
+            for (auto& it: candidates[j].entries) {
+                it.id = file.read<uint32_t>();
+                it.score = file.read<uint32_t>();
+                it.length = file.read<uint32_t>();
+            }
+
+            auto num_alignments = file.read<uint32_t>();
+            for (uint32_t k = 0; k < num_alignments; ++k) {
+                auto score = file.read<int32_t>();
+                auto evalue = file.read<double>();
+                auto target_id = file.read<uint32_t>();
+                auto query_begin = file.read<uint32_t>();
+                auto query_end = file.read<uint32_t>();
+                auto target_begin = file.read<uint32_t>();
+                auto target_end = file.read<uint32_t>();
+                file.read(data);
+
+                runs.clear();
+                decodeAlignmentRuns(runs, data);
+                data.clear();
+                expandAlignmentRuns(data, runs);
+
+                alignments[i].emplace_back(createAlignment(score, evalue, i,
+                    target_id));
+                alignments[i].back()->update(query_begin, query_end, target_begin,
+                    target_end, reinterpret_cast<const unsigned char*>(data.data()),
+                    data.size(), queries[i], database[target_id],
+                    parameters[0].scorer);
+            }
+        }
+
+        mergeCandidates(indexes, candidates, parameters[0].max_candidates,
+            parameters[0].candidates_zscore);
+
+        alignments[i].erase(std::remove_if(alignments[i].begin(), alignments[i].end(),
+            [&](const std::unique_ptr<Alignment>& it) -> bool {
+                return !std::binary_search(indexes.begin(), indexes.end(),
+                    it->target_id());
+            }), alignments[i].end());
+
+        sortAlignments(alignments[i], parameters[0].max_alignments);
+    }
+
+    /* duplicate queries get the alignments of their first copy */
+    std::vector<uint32_t> duplicates;
+    findDuplicateChains(duplicates, queries);
+
+    auto writer = createWriter(output_path, output_format, parameters[0].scorer);
+    writer->write_alignments(alignments, duplicates, queries, database,
+        thread_pool);
+}
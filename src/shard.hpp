@@ -0,0 +1,71 @@
+/*!
+ * @file shard.hpp
+ *
+ * @brief Partial results of database shards header file
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+
+namespace thread_pool {
+    class ThreadPool;
+}
+
+class Chain;
+class Alignment;
+class ScoreMatrix;
+struct QueryCandidates;
+enum class OutputType;
+enum class AlignmentType;
+enum class AlphabetType;
+
+using ChainSet = std::vector<std::unique_ptr<Chain>>;
+using AlignmentSet = std::vector<std::unique_ptr<Alignment>>;
+using CandidateSet = std::vector<QueryCandidates>;
+
+/*!
+ * @brief Search parameters which all shards of a search have to share
+ */
+struct ShardParameters {
+    uint32_t shard;
+    uint32_t num_shards;
+    /* residues of the whole database, needed for EValue */
+    uint64_t database_cells;
+    uint32_t num_queries;
+    std::shared_ptr<ScoreMatrix> scorer;
+    uint32_t max_candidates;
+    double candidates_zscore;
+    double max_evalue;
+    uint32_t max_alignments;
+    AlignmentType algorithm;
+    /* kmers of the search, seeds as in Kmers::seeds */
+    uint32_t kmer_length;
+    uint32_t threshold;
+    uint32_t max_neighbours;
+    AlphabetType alphabet;
+    std::vector<uint32_t> seeds;
+    bool mask_low_complexity;
+    bool dedup_targets;
+};
+
+/*!
+ * @brief Writes candidates and alignments of queries found in a shard of the
+ * database (see searchDatabase and alignDatabase with search orders) to path,
+ * together with the targets of the alignments
+ */
+void writeShard(const std::string& path, const ShardParameters& parameters,
+    const CandidateSet& candidates, const std::vector<AlignmentSet>& alignments,
+    const ChainSet& database);
+
+/*!
+ * @brief Merges partial results of all shards of a search and writes the
+ * alignments exactly as a search of the whole database would
+ */
+void mergeShards(const std::vector<std::string>& paths,
+    const std::string& queries_path, const std::string& output_path,
+    OutputType output_format,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
@@ -5,9 +5,64 @@
  */
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "utils.hpp"
 
+size_t cacheSize(uint32_t level) {
+
+    char path[128];
+    char buffer[64];
+
+    for (uint32_t i = 0; ; ++i) {
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/", i);
+        size_t path_length = strlen(path);
+
+        auto read_value = [&](const char* name) -> bool {
+            snprintf(path + path_length, sizeof(path) - path_length, "%s", name);
+            auto f = fopen(path, "r");
+            if (f == nullptr) {
+                return false;
+            }
+            auto status = fgets(buffer, sizeof(buffer), f) != nullptr;
+            fclose(f);
+            return status;
+        };
+
+        if (!read_value("level")) {
+            break;
+        }
+        if (strtoul(buffer, nullptr, 10) != level) {
+            continue;
+        }
+
+        if (!read_value("type") || strncmp(buffer, "Instruction", 11) == 0) {
+            continue;
+        }
+
+        if (!read_value("size")) {
+            break;
+        }
+
+        char* unit = nullptr;
+        size_t size = strtoul(buffer, &unit, 10);
+        switch (*unit) {
+            case 'K':
+                return size << 10;
+            case 'M':
+                return size << 20;
+            case 'G':
+                return size << 30;
+            default:
+                return size;
+        }
+    }
+
+    return 0;
+}
+
 Timer::Timer()
     : paused_(false), time_(0), timeval_() {
 }
@@ -12,6 +12,12 @@
 #include <future>
 #include <sys/time.h>
 
+/*!
+ * @brief Returns the size in bytes of the data (or unified) cache of the given
+ * level seen by the first cpu, read from sysfs, or 0 if it is unknown
+ */
+size_t cacheSize(uint32_t level);
+
 class Timer {
 public:
 
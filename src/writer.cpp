@@ -10,16 +10,18 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <algorithm>
+
+#include "thread_pool/thread_pool.hpp"
 
 #include "chain.hpp"
 #include "score_matrix.hpp"
 #include "database_alignment.hpp"
+#include "alignment_reader.hpp"
 #include "writer.hpp"
 
-constexpr int kMatch = 0;  // a match
-constexpr int kDeletion = 1;  // deletion from query (insertion to target)
-constexpr int kInsertion = 2;  // insertion to query (deletion from target)
-constexpr int kMismatch = 3;  // mismatch
+constexpr uint32_t kQueriesPerTask = 64;
+constexpr uint32_t kTasksPerThread = 4;  // tasks in flight while writing
 
 std::unique_ptr<Writer> createWriter(const std::string& path, OutputType format,
   std::shared_ptr<ScoreMatrix> scorer) {
@@ -29,8 +31,79 @@ std::unique_ptr<Writer> createWriter(const std::string& path, OutputType format,
   return std::unique_ptr<Writer>(new Writer(output_file, format, scorer));
 }
 
-Writer::Writer(FILE* output_file, OutputType format, std::shared_ptr<ScoreMatrix>& scorer)
-    : output_file_(output_file), format_(format), scorer_(scorer) {
+std::unique_ptr<Writer> createWriter(int file_descriptor, OutputType format,
+  std::shared_ptr<ScoreMatrix> scorer) {
+
+  auto output_file = fdopen(file_descriptor, "w");
+
+  return std::unique_ptr<Writer>(new Writer(output_file, format, scorer));
+}
+
+/* fast replacements of printf conversions used in all formats */
+
+// %d, %-<width>d (left) and %<width>d
+static void appendInt(std::string& dst, int64_t value, uint32_t width = 0,
+  bool left = false) {
+
+  char buffer[24];
+  char* end = buffer + sizeof(buffer);
+  char* begin = end;
+
+  uint64_t abs_value = value < 0 ? -static_cast<uint64_t>(value) : value;
+  do {
+    *--begin = '0' + abs_value % 10;
+    abs_value /= 10;
+  } while (abs_value != 0);
+  if (value < 0) {
+    *--begin = '-';
+  }
+
+  uint32_t length = end - begin;
+  if (!left && length < width) {
+    dst.append(width - length, ' ');
+  }
+  dst.append(begin, length);
+  if (left && length < width) {
+    dst.append(width - length, ' ');
+  }
+}
+
+// %.0f (rounds half to even like printf)
+static void appendRounded(std::string& dst, double value) {
+  appendInt(dst, static_cast<int64_t>(nearbyint(value)));
+}
+
+// conversions of doubles in exponent notation are left to snprintf
+static void appendDouble(std::string& dst, const char* format, double value) {
+  char buffer[64];
+  auto length = snprintf(buffer, sizeof(buffer), format, value);
+  dst.append(buffer, length);
+}
+
+// values of the binary format
+template<typename T>
+static void appendValue(std::string& dst, const T& value) {
+  dst.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void appendString(std::string& dst, const std::string& src) {
+  appendValue<uint32_t>(dst, src.size());
+  dst += src;
+}
+
+// first word of a name
+static void appendId(std::string& dst, const std::string& name) {
+  auto space_pos = name.find(' ');
+  dst.append(name, 0, space_pos);
+}
+
+Writer::Writer(FILE* output_file, OutputType format, std::shared_ptr<ScoreMatrix> scorer)
+    : output_file_(output_file), format_(format), scorer_(scorer), buffer_(),
+    is_target_written_() {
+
+  if (format_ == OutputType::kBin) {
+    write_header();
+  }
 }
 
 Writer::~Writer() {
@@ -39,20 +112,139 @@ Writer::~Writer() {
   }
 }
 
-void Writer::write_alignments(const AlignmentSet& alignments, const ChainSet& queries,
+void Writer::write_alignments(const AlignmentSet& alignments, const std::unique_ptr<Chain>& query,
   const ChainSet& database) {
 
+  buffer_.clear();
+  format_alignments(buffer_, alignments, query, database);
+  write(buffer_, alignments, database);
+}
+
+void Writer::write_alignments(const std::vector<AlignmentSet>& alignments,
+  const std::vector<uint32_t>& duplicates, const ChainSet& queries,
+  const ChainSet& database, std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+  auto format_part = [&](std::string& dst, uint32_t begin, uint32_t end) -> void {
+    dst.clear();
+    for (uint32_t i = begin; i < end; ++i) {
+      format_alignments(dst, alignments[duplicates[i]], queries[i], database);
+    }
+  };
+
+  if (!thread_pool) {
+    for (uint32_t i = 0; i < queries.size(); i += kQueriesPerTask) {
+      uint32_t end = std::min<uint32_t>(i + kQueriesPerTask, queries.size());
+      format_part(buffer_, i, end);
+      for (uint32_t j = i; j < end; ++j) {
+        write_targets(alignments[duplicates[j]], database);
+      }
+      write_buffer(buffer_);
+    }
+    return;
+  }
+
+  /* buffers of a window of tasks are written in order while later tasks of
+   * the window are still being formatted */
+  uint32_t num_tasks = thread_pool->num_threads() * kTasksPerThread;
+  std::vector<std::string> buffers(num_tasks);
+
+  for (uint32_t i = 0; i < queries.size(); i += num_tasks * kQueriesPerTask) {
+
+    std::vector<std::future<void>> thread_futures;
+    for (uint32_t j = 0; j < num_tasks; ++j) {
+      uint32_t begin = i + j * kQueriesPerTask;
+      if (begin >= queries.size()) {
+        break;
+      }
+      thread_futures.emplace_back(thread_pool->submit(format_part,
+        std::ref(buffers[j]), begin,
+        std::min<uint32_t>(begin + kQueriesPerTask, queries.size())));
+    }
+
+    for (uint32_t j = 0; j < thread_futures.size(); ++j) {
+      thread_futures[j].wait();
+      uint32_t begin = i + j * kQueriesPerTask;
+      uint32_t end = std::min<uint32_t>(begin + kQueriesPerTask, queries.size());
+      for (uint32_t k = begin; k < end; ++k) {
+        write_targets(alignments[duplicates[k]], database);
+      }
+      write_buffer(buffers[j]);
+    }
+  }
+}
+
+void Writer::flush() {
+  fflush(output_file_);
+}
+
+void Writer::write(const std::string& src, const AlignmentSet& alignments,
+  const ChainSet& database) {
+
+  write_targets(alignments, database);
+  write_buffer(src);
+}
+
+void Writer::write_header() {
+
+  buffer_.clear();
+  buffer_.append(kAlignmentMagic, sizeof(kAlignmentMagic));
+  appendValue(buffer_, kAlignmentFormat);
+  appendString(buffer_, scorer_->scorerName());
+  appendValue<int32_t>(buffer_, scorer_->gap_open());
+  appendValue<int32_t>(buffer_, scorer_->gap_extend());
+  write_buffer(buffer_);
+}
+
+void Writer::write_targets(const AlignmentSet& alignments, const ChainSet& database) {
+
+  if (format_ != OutputType::kBin) {
+    return;
+  }
+
+  std::string records;
+  for (const auto& alignment : alignments) {
+    auto target_id = alignment->target_id();
+    if (is_target_written_.size() <= target_id) {
+      is_target_written_.resize(target_id + 1, false);
+    }
+    if (is_target_written_[target_id]) {
+      continue;
+    }
+    is_target_written_[target_id] = true;
+
+    const auto& target = database[target_id];
+    appendValue(records, kTargetRecord);
+    appendValue(records, target_id);
+    appendValue<uint32_t>(records, target->length());
+    appendString(records, target->name());
+  }
+  write_buffer(records);
+}
+
+void Writer::write_buffer(const std::string& src) {
+  if (!src.empty()) {
+    fwrite(src.data(), 1, src.size(), output_file_);
+  }
+}
+
+void Writer::format_alignments(std::string& dst, const AlignmentSet& alignments,
+  const std::unique_ptr<Chain>& query, const ChainSet& database) const {
+
     switch (format_) {
       case OutputType::kBm0:
-        write_bm0(alignments, queries, database);
+        format_bm0(dst, alignments, query, database);
         break;
 
       case OutputType::kBm8:
-        write_bm8(alignments, queries, database);
+        format_bm8(dst, alignments, query, database);
         break;
 
       case OutputType::kBm9:
-        write_bm9(alignments, queries, database);
+        format_bm9(dst, alignments, query, database);
+        break;
+
+      case OutputType::kBin:
+        format_bin(dst, alignments, query);
         break;
 
       default:
@@ -61,23 +253,26 @@ void Writer::write_alignments(const AlignmentSet& alignments, const ChainSet& qu
     }
 }
 
-void Writer::write_bm0(const AlignmentSet& alignments, const ChainSet& queries,
-  const ChainSet& database) {
+void Writer::format_bm0(std::string& dst, const AlignmentSet& alignments,
+  const std::unique_ptr<Chain>& query, const ChainSet& database) const {
 
   if (alignments.size() == 0) {
-    fprintf(output_file_, "No alignments found\n");
+    dst += "No alignments found\n";
     return;
   }
 
-  auto query_id = alignments[0]->query_id();
-  auto& query = queries[query_id];
   const auto& query_seq = query->data();
-
-  fprintf(output_file_, "Query= %s\n", query->name().c_str());
-  fprintf(output_file_, "Length=%zu\n\n", query->length());
-  fprintf(output_file_, "Sequences producing significant alignments:");
-  fprintf(output_file_, "%27.27s", "Score");
-  fprintf(output_file_, "%10.10s\n\n", "Evalue");
+  std::vector<uint32_t> runs;
+  std::string alignment_str;
+
+  dst += "Query= ";
+  dst += query->name();
+  dst += "\nLength=";
+  appendInt(dst, query->length());
+  dst += "\n\n";
+  dst += "Sequences producing significant alignments:";
+  dst += "                      Score";
+  dst += "    Evalue\n\n";
 
   for (const auto& alignment : alignments) {
     auto target_id = alignment->target_id();
@@ -87,14 +282,18 @@ void Writer::write_bm0(const AlignmentSet& alignments, const ChainSet& queries,
     auto score = alignment->score();
     auto eval = alignment->evalue();
 
+    dst += "     ";
     if (name.size() > 64) {
-      fprintf(output_file_, "     %.64s...%10d%10.0e\n", name.c_str(), score, eval);
+      dst.append(name, 0, 64);
+      dst += "...";
     } else {
-      fprintf(output_file_, "     %.67s%10d%10.0e\n", name.c_str(), score, eval);
+      dst += name;
     }
+    appendInt(dst, score, 10);
+    appendDouble(dst, "%10.0e\n", eval);
   }
 
-  fprintf(output_file_, "\n");
+  dst += "\n";
 
   for (const auto& alignment : alignments) {
     auto target_id = alignment->target_id();
@@ -104,199 +303,185 @@ void Writer::write_bm0(const AlignmentSet& alignments, const ChainSet& queries,
     auto align_target_start = alignment->target_begin();
     auto align_query_start = alignment->query_begin();
 
-    fprintf(output_file_, ">%s\n", target_name.c_str());
-    fprintf(output_file_, "Length=%zu\n\n", target->length());
-    fprintf(output_file_, " Score = %d,", alignment->score());
-    fprintf(output_file_, " Expect = %.0e\n", alignment->evalue());
+    dst += ">";
+    dst += target_name;
+    dst += "\nLength=";
+    appendInt(dst, target->length());
+    dst += "\n\n Score = ";
+    appendInt(dst, alignment->score());
+    appendDouble(dst, ", Expect = %.0e\n", alignment->evalue());
 
-    const auto& alignment_str = alignment->alignment();
-    int identities = 0;
-    int positives = 0;
-    int gaps = 0;
-    auto alignment_len = alignment_str.size();
-
-    auto query_ptr = align_query_start;
-    auto target_ptr = align_target_start;
-
-    for (uint32_t j = 0; j < alignment_len; ++j) {
-      int align_res = alignment_str[j];
-
-      if (align_res == kMatch) {
-        identities++;
-        positives++;
-        query_ptr++;
-        target_ptr++;
-      } else if (align_res == kDeletion) {
-        gaps++;
-        query_ptr++;
-      } else if (align_res == kInsertion) {
-        gaps++;
-        target_ptr++;
-      } else {
-        if (scorer_->score(query_seq[query_ptr], target_seq[target_ptr]) > 0) {
-          positives++;
-        }
-        query_ptr++;
-        target_ptr++;
-      }
-    }
+    auto identities = alignment->identities();
+    auto positives = alignment->positives();
+    auto gaps = alignment->gaps();
+    auto alignment_len = alignment->length();
 
     int idn_pct = static_cast<int>(floor(identities*100.f/alignment_len));
     int pos_pct = static_cast<int>(floor(positives*100.f/alignment_len));
     int gap_pct = static_cast<int>(floor(gaps*100.f/alignment_len));
 
-    fprintf(output_file_, " Identities = %d/%lu (%d%%),", identities, alignment_len, idn_pct);
-    fprintf(output_file_, " Positives = %d/%lu (%d%%),", positives, alignment_len, pos_pct);
-    fprintf(output_file_, " Gaps = %d/%lu (%d%%)", gaps, alignment_len, gap_pct);
-    fprintf(output_file_, "\n\n");
-
-    char query_str[61] = { 0 };
-    char target_str[61] = { 0 };
-    char markup_str[61] = { 0 };
+    dst += " Identities = ";
+    appendInt(dst, identities);
+    dst += "/";
+    appendInt(dst, alignment_len);
+    dst += " (";
+    appendInt(dst, idn_pct);
+    dst += "%), Positives = ";
+    appendInt(dst, positives);
+    dst += "/";
+    appendInt(dst, alignment_len);
+    dst += " (";
+    appendInt(dst, pos_pct);
+    dst += "%), Gaps = ";
+    appendInt(dst, gaps);
+    dst += "/";
+    appendInt(dst, alignment_len);
+    dst += " (";
+    appendInt(dst, gap_pct);
+    dst += "%)\n\n";
+
+    std::string query_str, target_str, markup_str;
 
     auto query_start = align_query_start;
     auto query_end = query_start;
     auto target_start = align_target_start;
     auto target_end = target_start;
 
+    runs.clear();
+    decodeAlignmentRuns(runs, alignment->runs());
+    alignment_str.clear();
+    expandAlignmentRuns(alignment_str, runs);
+
     for (uint32_t j = 0; j < alignment_len; ++j) {
       int align_res = alignment_str[j];
-      int index = j % 60;
 
-      if (align_res == kMatch) {
-        markup_str[index] = query_seq[query_end] + 'A';
-        query_str[index] = query_seq[query_end++] + 'A';
-        target_str[index] = target_seq[target_end++] + 'A';
-      } else if (align_res == kMismatch) {
+      if (align_res == kMatchOperation) {
+        markup_str += query_seq[query_end] + 'A';
+        query_str += query_seq[query_end++] + 'A';
+        target_str += target_seq[target_end++] + 'A';
+      } else if (align_res == kMismatchOperation) {
         if (scorer_->score(query_seq[query_end], target_seq[target_end]) > 0) {
-          markup_str[index] = '+';
+          markup_str += '+';
         } else {
-          markup_str[index] = ' ';
+          markup_str += ' ';
         }
-        query_str[index] = query_seq[query_end++] + 'A';
-        target_str[index] = target_seq[target_end++] + 'A';
-      } else if (align_res == kDeletion) {
-        markup_str[index] = ' ';
-        query_str[index] = query_seq[query_end++] + 'A';
-        target_str[index] = '-';
+        query_str += query_seq[query_end++] + 'A';
+        target_str += target_seq[target_end++] + 'A';
+      } else if (align_res == kDeletionOperation) {
+        markup_str += ' ';
+        query_str += query_seq[query_end++] + 'A';
+        target_str += '-';
       } else {
-        markup_str[index] = ' ';
-        query_str[index] = '-';
-        target_str[index] = target_seq[target_end++] + 'A';
+        markup_str += ' ';
+        query_str += '-';
+        target_str += target_seq[target_end++] + 'A';
       }
 
       if ((j+1) % 60 == 0 || j == alignment_len-1) {
-        fprintf(output_file_, "Query  %-6d%s  %d\n"
-                              "%12s %s %s\n"
-                              "Sbjct  %-6d%s  %d\n\n",
-                                query_start+1, query_str, query_end,
-                                "", markup_str, "",
-                                target_start+1, target_str, target_end);
+        dst += "Query  ";
+        appendInt(dst, query_start+1, 6, true);
+        dst += query_str;
+        dst += "  ";
+        appendInt(dst, query_end);
+        dst += "\n             ";
+        dst += markup_str;
+        dst += " \nSbjct  ";
+        appendInt(dst, target_start+1, 6, true);
+        dst += target_str;
+        dst += "  ";
+        appendInt(dst, target_end);
+        dst += "\n\n";
 
         query_start = query_end;
         target_start = target_end;
 
-        memset(query_str, 0, 61 * sizeof(char));
-        memset(target_str, 0, 61 * sizeof(char));
-        memset(markup_str, 0, 61 * sizeof(char));
+        query_str.clear();
+        target_str.clear();
+        markup_str.clear();
       }
     }
-    fprintf(output_file_, "\n");
+    dst += "\n";
   }
 
-  fprintf(output_file_, "Matrix: %s\n", scorer_->scorerName().c_str());
-  fprintf(output_file_, "Gap Penalties: Existence: %d, Extension: %d\n",
-      scorer_->gap_open(), scorer_->gap_extend());
+  dst += "Matrix: ";
+  dst += scorer_->scorerName();
+  dst += "\nGap Penalties: Existence: ";
+  appendInt(dst, scorer_->gap_open());
+  dst += ", Extension: ";
+  appendInt(dst, scorer_->gap_extend());
+  dst += "\n";
 }
 
-void Writer::write_bm8(const AlignmentSet& alignments, const ChainSet& queries,
-  const ChainSet& database) {
-
-  if (alignments.size() == 0) {
-    return;
-  }
-
-  auto query_id = alignments[0]->query_id();
-  auto query_name = queries[query_id]->name();
-
-  auto space_pos = query_name.find(" ", 0);
-  if (space_pos != std::string::npos) {
-    query_name = query_name.substr(0, space_pos);
-  }
+void Writer::format_bm8(std::string& dst, const AlignmentSet& alignments,
+  const std::unique_ptr<Chain>& query, const ChainSet& database) const {
 
   for (const auto& alignment : alignments) {
-    int mismatches = 0;
-    int gap_openings = 0;
-    int matches = 0;
-    bool gap = false;
-
-    const auto& alignment_str = alignment->alignment();
-    const auto alignment_len = alignment_str.size();
-
-    for (uint32_t j = 0; j < alignment_len; ++j) {
-      int alignment_res = alignment_str[j];
-      // printf("Alignment res %d\n", alignment_res);
-      // return;
-
-      switch (alignment_res) {
-        case kMismatch:
-          mismatches++;
-          gap = false;
-          break;
-        case kInsertion:
-          if (!gap) {
-            gap = true;
-            gap_openings++;
-          }
-          break;
-        case kDeletion:
-          if (!gap) {
-            gap = true;
-            gap_openings++;
-          }
-          break;
-        default:
-          matches++;
-          gap = false;
-      }
-    }
-
     auto target_id = alignment->target_id();
-    auto target_name = database[target_id]->name();
-
-    space_pos = target_name.find(" ", 0);
-    if (space_pos != std::string::npos) {
-      target_name = target_name.substr(0, space_pos);
-    }
-
-    double perc_id = (100.f * matches) / alignment_len;
 
-    fprintf(output_file_, "%s\t%s\t", query_name.c_str(), target_name.c_str());
-    fprintf(output_file_, "%.lf\t%lu\t%d\t", perc_id, alignment_len, mismatches);
-    fprintf(output_file_, "%d\t%d\t", gap_openings, alignment->query_begin()+1);
-    fprintf(output_file_, "%d\t%d\t", alignment->query_end()+1, alignment->target_begin()+1);
-    fprintf(output_file_, "%d\t", alignment->target_end()+1);
+    double perc_id = (100.f * alignment->identities()) / alignment->length();
+
+    appendId(dst, query->name());
+    dst += '\t';
+    appendId(dst, database[target_id]->name());
+    dst += '\t';
+    appendRounded(dst, perc_id);
+    dst += '\t';
+    appendInt(dst, alignment->length());
+    dst += '\t';
+    appendInt(dst, alignment->mismatches());
+    dst += '\t';
+    appendInt(dst, alignment->gap_openings());
+    dst += '\t';
+    appendInt(dst, alignment->query_begin()+1);
+    dst += '\t';
+    appendInt(dst, alignment->query_end()+1);
+    dst += '\t';
+    appendInt(dst, alignment->target_begin()+1);
+    dst += '\t';
+    appendInt(dst, alignment->target_end()+1);
+    dst += '\t';
 
     auto eval = alignment->evalue();
     auto score = alignment->score();
 
     if (eval >= 1e-2 && eval < 100) {
-      fprintf(output_file_, "%.2lf\t", eval);
+      appendDouble(dst, "%.2lf\t", eval);
     } else {
-      fprintf(output_file_, "%.2e\t", eval);
+      appendDouble(dst, "%.2e\t", eval);
     }
 
-    fprintf(output_file_, "%d", score);
-    fprintf(output_file_, "\n");
+    appendInt(dst, score);
+    dst += '\n';
   }
 }
 
-void Writer::write_bm9(const AlignmentSet& alignments, const ChainSet& queries,
-  const ChainSet& database) {
+void Writer::format_bm9(std::string& dst, const AlignmentSet& alignments,
+  const std::unique_ptr<Chain>& query, const ChainSet& database) const {
+
+  dst += "# Fields:\n";
+  dst += "Query id,Subject id,% identity,alignment length,mismatches,"
+    "gap openings,q. start,q. end,s. start,s. end,e-value,score\n";
+
+  format_bm8(dst, alignments, query, database);
+}
 
-  fprintf(output_file_, "# Fields:\n");
-  fprintf(output_file_, "Query id,Subject id,%% identity,alignment length,mismatches,"
-    "gap openings,q. start,q. end,s. start,s. end,e-value,score\n");
+void Writer::format_bin(std::string& dst, const AlignmentSet& alignments,
+  const std::unique_ptr<Chain>& query) const {
 
-  write_bm8(alignments, queries, database);
+  appendValue(dst, kQueryRecord);
+  appendValue<uint32_t>(dst, query->length());
+  appendString(dst, query->name());
+  appendValue<uint32_t>(dst, alignments.size());
+
+  for (const auto& alignment : alignments) {
+    appendValue(dst, alignment->target_id());
+    appendValue(dst, alignment->score());
+    appendValue(dst, alignment->evalue());
+    appendValue(dst, alignment->query_begin());
+    appendValue(dst, alignment->query_end());
+    appendValue(dst, alignment->target_begin());
+    appendValue(dst, alignment->target_end());
+
+    appendString(dst, alignment->runs());
+  }
 }
@@ -7,9 +7,15 @@
 #pragma once
 
 #include <cstdio>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <fstream>
+#include <memory>
+
+namespace thread_pool {
+  class ThreadPool;
+}
 
 class Chain;
 class ScoreMatrix;
@@ -23,37 +29,91 @@ enum class OutputType {
   kBm0, // BLAST m0
   kBm8, // BLAST m8
   kBm9, // BLAST m9
+  kBin, // binary records, see alignment_reader.hpp
 };
 
 std::unique_ptr<Writer> createWriter(const std::string& path, OutputType format,
   std::shared_ptr<ScoreMatrix> scorer);
 
+/*!
+ * @brief Creates a writer to an open file descriptor (e.g. a socket), which is
+ * closed with the writer
+ */
+std::unique_ptr<Writer> createWriter(int file_descriptor, OutputType format,
+  std::shared_ptr<ScoreMatrix> scorer);
+
 class Writer {
  public:
   ~Writer();
 
-  void write_alignments(const AlignmentSet& alignments, const ChainSet& queries,
+  /*!
+   * @brief Writes alignments of query, which are not required to have
+   * query->id() as their query id (e.g. for duplicate queries)
+   */
+  void write_alignments(const AlignmentSet& alignments, const std::unique_ptr<Chain>& query,
     const ChainSet& database);
 
+  /*!
+   * @brief Writes alignments of all queries in their order, alignments of
+   * queries[i] are alignments[duplicates[i]] (see findDuplicateChains)
+   * @details Queries are formatted in parallel into separate buffers which
+   * are written in order with large writes as soon as they are ready.
+   */
+  void write_alignments(const std::vector<AlignmentSet>& alignments,
+    const std::vector<uint32_t>& duplicates, const ChainSet& queries,
+    const ChainSet& database,
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool = nullptr);
+
+  /*!
+   * @brief Appends formatted alignments of query to dst (without writing
+   * them), can be called from several threads
+   */
+  void format_alignments(std::string& dst, const AlignmentSet& alignments,
+    const std::unique_ptr<Chain>& query, const ChainSet& database) const;
+
+  /*!
+   * @brief Writes formatted alignments (see format_alignments), preceded by
+   * targets of the alignments which were not written before (binary format)
+   */
+  void write(const std::string& src, const AlignmentSet& alignments,
+    const ChainSet& database);
+
+  void flush();
+
   friend std::unique_ptr<Writer> createWriter(const std::string& path, OutputType format,
     std::shared_ptr<ScoreMatrix> scorer);
 
+  friend std::unique_ptr<Writer> createWriter(int file_descriptor, OutputType format,
+    std::shared_ptr<ScoreMatrix> scorer);
+
  private:
-  Writer(FILE* output_file, OutputType format, std::shared_ptr<ScoreMatrix>& scorer);
+  Writer(FILE* output_file, OutputType format, std::shared_ptr<ScoreMatrix> scorer);
 
   Writer(const Writer&) = delete;
   const Writer& operator=(const Writer&) = delete;
 
-  void write_bm0(const AlignmentSet& alignments, const ChainSet& queries,
-    const ChainSet& database);
+  void write_header();
 
-  void write_bm8(const AlignmentSet& alignments, const ChainSet& queries,
-    const ChainSet& database);
+  void write_targets(const AlignmentSet& alignments, const ChainSet& database);
 
-  void write_bm9(const AlignmentSet& alignments, const ChainSet& queries,
-    const ChainSet& database);
+  void write_buffer(const std::string& src);
+
+  void format_bm0(std::string& dst, const AlignmentSet& alignments,
+    const std::unique_ptr<Chain>& query, const ChainSet& database) const;
+
+  void format_bm8(std::string& dst, const AlignmentSet& alignments,
+    const std::unique_ptr<Chain>& query, const ChainSet& database) const;
+
+  void format_bm9(std::string& dst, const AlignmentSet& alignments,
+    const std::unique_ptr<Chain>& query, const ChainSet& database) const;
+
+  void format_bin(std::string& dst, const AlignmentSet& alignments,
+    const std::unique_ptr<Chain>& query) const;
 
   FILE* output_file_;
   OutputType format_;
-  std::shared_ptr<ScoreMatrix>& scorer_;
+  std::shared_ptr<ScoreMatrix> scorer_;
+  std::string buffer_;
+  // targets whose records were written (binary format)
+  std::vector<bool> is_target_written_;
 };
@@ -0,0 +1,201 @@
+/*!
+ * @file search_test.cpp
+ *
+ * @brief Searches of small databases through library sword (see
+ * src/searcher.hpp), run with ctest
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "thread_pool/thread_pool.hpp"
+
+#include "chain.hpp"
+#include "searcher.hpp"
+
+static uint32_t num_failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        ++num_failures; \
+    }
+
+static std::string writeDatabase(const std::string& name,
+    const std::vector<std::string>& chains) {
+
+    auto path = std::string(TEST_OUTPUT_DIR) + "/" + name + ".fa";
+    auto file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "unable to create %s\n", path.c_str());
+        exit(1);
+    }
+    for (uint32_t i = 0; i < chains.size(); ++i) {
+        fprintf(file, ">target_%u\n%s\n", i, chains[i].c_str());
+    }
+    fclose(file);
+
+    return path;
+}
+
+static ChainSet createQueries(const std::vector<std::string>& chains) {
+
+    ChainSet dst;
+    for (uint32_t i = 0; i < chains.size(); ++i) {
+        auto name = "query_" + std::to_string(i);
+        auto data = chains[i];
+        dst.emplace_back(createChain(i, &name[0], name.size(), &data[0],
+            data.size()));
+    }
+    return dst;
+}
+
+static std::vector<uint32_t> targetIds(const AlignmentSet& alignments) {
+
+    std::vector<uint32_t> dst;
+    for (const auto& it: alignments) {
+        dst.emplace_back(it->target_id());
+    }
+    std::sort(dst.begin(), dst.end());
+    return dst;
+}
+
+/* queries and targets shorter than the span of a spaced seed have no kmers,
+ * they must not disturb the diagonals of other queries in their group */
+static void testShortChains(std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto database_path = writeDatabase("short_chains", {"MKVLAAGI", "LLLAAHE",
+        "MK"});
+
+    SearchOptions options;
+    options.seeds = {0x6B}; /* 1101011 */
+    std::string error;
+    auto searcher = createSearcher(database_path, options, error, thread_pool);
+    CHECK(searcher != nullptr);
+
+    std::vector<std::string> long_query = {"MKVLAAGIVGLLLAAHEEKKWWPRST"};
+    std::vector<std::string> mixed_queries = {"MK", "MKVLAAGIVGLLLAAHEEKKWWPRST",
+        "A", "LLLAAHEEKKW"};
+
+    auto queries = createQueries(long_query);
+    std::vector<AlignmentSet> alignments(queries.size());
+    searcher->search(alignments, queries);
+    CHECK(targetIds(alignments[0]) == std::vector<uint32_t>({0, 1}));
+
+    queries = createQueries(mixed_queries);
+    std::vector<AlignmentSet> mixed_alignments(queries.size());
+    searcher->search(mixed_alignments, queries);
+    CHECK(mixed_alignments[0].empty());
+    CHECK(targetIds(mixed_alignments[1]) == std::vector<uint32_t>({0, 1}));
+    CHECK(mixed_alignments[2].empty());
+    CHECK(targetIds(mixed_alignments[3]) == std::vector<uint32_t>({1}));
+}
+
+/* copies of a target left out of the search by dedup_targets are part of
+ * the score background, the candidates_zscore cut does not depend on it */
+static void testDuplicateTargets(std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    const std::string query = "MKVLAAGIVGLLLAAHEEKKWWPRSTQYNDCF";
+    const std::string residues = "ACDEFGHIKLMNPQRSTVWY";
+
+    uint32_t state = 7;
+    auto random_chain = [&](uint32_t length) -> std::string {
+        std::string dst;
+        for (uint32_t i = 0; i < length; ++i) {
+            state = state * 1103515245 + 12345;
+            dst += residues[(state >> 16) % residues.size()];
+        }
+        return dst;
+    };
+
+    /* unrelated targets, a target sharing a short stretch with the query
+     * and many copies of a target sharing a longer one */
+    std::vector<std::string> targets;
+    for (uint32_t i = 0; i < 40; ++i) {
+        targets.emplace_back(random_chain(40));
+    }
+    targets.emplace_back(random_chain(15) + query.substr(20, 5) + random_chain(15));
+    auto copy = random_chain(15) + query.substr(0, 6) + random_chain(15);
+    for (uint32_t i = 0; i < 20; ++i) {
+        targets.emplace_back(copy);
+    }
+    auto database_path = writeDatabase("duplicate_targets", targets);
+
+    std::vector<std::vector<uint32_t>> target_ids;
+    for (bool dedup_targets: {false, true}) {
+
+        SearchOptions options;
+        options.candidates_zscore = 1;
+        options.max_evalue = 1e9;
+        options.max_alignments = targets.size();
+        options.dedup_targets = dedup_targets;
+        std::string error;
+        auto searcher = createSearcher(database_path, options, error,
+            thread_pool);
+        CHECK(searcher != nullptr);
+
+        auto queries = createQueries({query});
+        std::vector<AlignmentSet> alignments(queries.size());
+        searcher->search(alignments, queries);
+        target_ids.emplace_back(targetIds(alignments[0]));
+    }
+
+    CHECK(target_ids[0] == target_ids[1]);
+    CHECK(target_ids[0].size() >= 20);
+}
+
+/* invalid options and unreadable databases are reported to the caller */
+static void testSearcherErrors(std::shared_ptr<thread_pool::ThreadPool> thread_pool) {
+
+    auto database_path = writeDatabase("searcher_errors", {"MKVLAAGI"});
+    std::string error;
+
+    SearchOptions options;
+    options.kmer_length = 7;
+    CHECK(createSearcher(database_path, options, error, thread_pool) == nullptr);
+    CHECK(error.find("kmer length") != std::string::npos);
+
+    options = SearchOptions();
+    options.seeds = {0x6A}; /* 1101010 */
+    CHECK(createSearcher(database_path, options, error, thread_pool) == nullptr);
+    CHECK(error.find("seeds") != std::string::npos);
+
+    options = SearchOptions();
+    auto missing_path = std::string(TEST_OUTPUT_DIR) + "/missing.fa";
+    CHECK(createSearcher(missing_path, options, error, thread_pool) == nullptr);
+    CHECK(error.find("unable to open file") != std::string::npos);
+
+    /* gzip magic followed by garbage */
+    auto corrupted_path = std::string(TEST_OUTPUT_DIR) + "/corrupted.fa.gz";
+    auto file = fopen(corrupted_path.c_str(), "wb");
+    CHECK(file != nullptr);
+    if (file != nullptr) {
+        fputs("\x1f\x8b\x08\x00garbage", file);
+        fclose(file);
+    }
+    CHECK(createSearcher(corrupted_path, options, error, thread_pool) == nullptr);
+    CHECK(error.find("unable to read database") != std::string::npos);
+
+    error.clear();
+    CHECK(createSearcher(database_path, options, error, thread_pool) != nullptr);
+    CHECK(error.empty());
+}
+
+int main() {
+
+    std::shared_ptr<thread_pool::ThreadPool> thread_pool =
+        thread_pool::createThreadPool(2);
+
+    testShortChains(thread_pool);
+    testDuplicateTargets(thread_pool);
+    testSearcherErrors(thread_pool);
+
+    if (num_failures > 0) {
+        fprintf(stderr, "%u checks failed\n", num_failures);
+        return 1;
+    }
+    return 0;
+}